@@ -0,0 +1,323 @@
+/* ollieberzs 2018
+** box.hpp
+** nan-boxed value handle
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <utility>
+#include "common.hpp"
+#include "pool.hpp"
+
+OCA_BEGIN
+
+// a value fits in 64 bits, reals are stored as plain doubles and every
+// other type goes in the payload of a negative quiet nan, with the type tag
+// in the three bits above the 48 bit payload. strings of up to five bytes
+// keep their bytes in the low end of the payload and their length above
+class Value {
+public:
+    // nil is NONE, the NIL name belongs to the macro
+    enum Tag : uint64_t { EMPTY, NONE, BOOL, INT, OBJECT, STR, REAL };
+
+    Value();
+    Value(std::nullptr_t);
+    explicit Value(Object* object);
+    Value(const Value& other);
+    Value(Value&& other) noexcept;
+    Value& operator=(const Value& other);
+    Value& operator=(Value&& other) noexcept;
+    ~Value();
+
+    // nil has no heap part, every nil is the same immortal bit pattern
+    static Value nil();
+    static Value boolean(bool val);
+    static Value integer(oca_int val);
+    static Value real(oca_real val);
+    // short strings are immediates and the rest are interned per State
+    static Value string(std::string_view val);
+    static Value string(std::string&& val);
+    template <class T, class... Args>
+    static Value make(Args&&... args);
+
+    // empty values mark a missing value, like a null pointer did
+    explicit operator bool() const;
+    bool operator==(const Value& other) const;
+    bool operator!=(const Value& other) const;
+
+    // keeps 'arg.value->toi()' style code working
+    Value* operator->();
+    const Value* operator->() const;
+
+    Tag tag() const;
+    bool isNil() const;
+    bool isi() const;
+    bool isr() const;
+    bool isb() const;
+    bool iss() const;
+    bool ist() const;
+
+    oca_int toi() const;
+    oca_real tor() const;
+    bool tob() const;
+
+    Object* object() const;
+    template <class T>
+    bool is() const;
+    template <class T>
+    T& as() const;
+
+    Value copy() const;
+    std::string tos() const;
+    // the bytes of a string, valid as long as this value is
+    std::string_view view() const;
+    std::string typestr() const;
+
+    // indexed elements, used when splitting a value into names
+    oca_int length() const;
+    Value item(oca_int index) const;
+
+private:
+    static constexpr uint64_t BOX = 0xFFF8000000000000;
+    static constexpr uint64_t CANONICAL_NAN = 0x7FF8000000000000;
+    static constexpr uint64_t PAYLOAD = 0x0000FFFFFFFFFFFF;
+    static constexpr oca_int INT_MAX48 = (oca_int(1) << 47) - 1;
+    static constexpr oca_int INT_MIN48 = -(oca_int(1) << 47);
+    static constexpr size_t SHORT_STR = 5;
+    static constexpr size_t INTERNED_STR = 40;
+
+    uint64_t bits;
+
+    explicit Value(uint64_t bits, int);
+    static uint64_t boxed(Tag tag, uint64_t payload);
+    void retain() const;
+    void release();
+};
+
+// the heap part of strings, tables, ranges, blocks, funcs and wide ints
+class Object {
+public:
+    enum Color : uint8_t { BLACK, GRAY, WHITE };
+    enum Kind : uint8_t { INTEGER, STRING, CHUNK, TABLE, RANGE, BLOCK, CELL, FUNC };
+
+    RefCount refs{0};
+    // tables, blocks and cells can hold themselves, the cycle collector
+    // looks at them when their count drops without reaching zero
+    bool container = false;
+    Color color = BLACK;
+    // minor collections survived as a suspect
+    uint8_t age = 0;
+    // the class of the object, so checking a type needs no rtti
+    const Kind kind;
+    // position + 1 in the suspects of the pool, 0 when not a suspect
+    uint root = 0;
+
+    explicit Object(Kind kind) : kind(kind) {}
+    Object(const Object& other) : refs(0), kind(other.kind) {}
+    virtual ~Object() = default;
+
+    static void* operator new(size_t size);
+    static void operator delete(void* ptr, size_t size);
+
+    // assigning and binding a value copies it, so this has to stay cheap.
+    // strings and numbers never change in place and tables are shared on
+    // purpose, so the default hands out the same object
+    virtual Value copy();
+    virtual std::string tos() = 0;
+    virtual std::string typestr() = 0;
+    virtual oca_int length();
+    virtual Value item(oca_int index);
+
+    // containers list the containers they hold and drop them when collected
+    virtual void trace(std::vector<Object*>& out);
+    virtual void clear();
+
+    void suspect();
+    void forget();
+};
+
+// ---------------------------------
+
+inline uint64_t Value::boxed(Tag tag, uint64_t payload) {
+    return BOX | (static_cast<uint64_t>(tag) << 48) | (payload & PAYLOAD);
+}
+
+inline Value::Value(uint64_t bits, int) : bits(bits) {}
+
+inline Value::Value() : bits(boxed(EMPTY, 0)) {}
+
+inline Value::Value(std::nullptr_t) : bits(boxed(EMPTY, 0)) {}
+
+inline Value::Value(Object* object)
+    : bits(boxed(OBJECT, static_cast<uint64_t>(reinterpret_cast<uintptr_t>(object)))) {
+    retain();
+}
+
+inline Value::Value(const Value& other) : bits(other.bits) {
+    retain();
+}
+
+inline Value::Value(Value&& other) noexcept : bits(other.bits) {
+    other.bits = boxed(EMPTY, 0);
+}
+
+inline Value& Value::operator=(const Value& other) {
+    // read other first, releasing this may free the object holding it
+    uint64_t next = other.bits;
+    other.retain();
+    release();
+    bits = next;
+    return *this;
+}
+
+inline Value& Value::operator=(Value&& other) noexcept {
+    if (this != &other) {
+        // take other first, releasing this may free the object holding it
+        uint64_t next = other.bits;
+        other.bits = boxed(EMPTY, 0);
+        release();
+        bits = next;
+    }
+    return *this;
+}
+
+inline Value::~Value() {
+    release();
+}
+
+inline void Value::retain() const {
+    if (Object* obj = object())
+        ++obj->refs;
+}
+
+inline void Value::release() {
+    if (Object* obj = object()) {
+        if (--obj->refs == 0) {
+            if (obj->root)
+                obj->forget();
+            delete obj;
+        } else if (obj->container)
+            obj->suspect();
+    }
+}
+
+inline Value Value::copy() const {
+    Object* obj = object();
+    return (obj) ? obj->copy() : *this;
+}
+
+inline void* Object::operator new(size_t size) {
+    return Pool::allocate(size);
+}
+
+inline void Object::operator delete(void* ptr, size_t size) {
+    Pool::deallocate(ptr, size);
+}
+
+inline Value Value::nil() {
+    return Value(boxed(NONE, 0), 0);
+}
+
+inline Value Value::boolean(bool val) {
+    return Value(boxed(BOOL, val), 0);
+}
+
+inline Value Value::real(oca_real val) {
+    uint64_t bits = CANONICAL_NAN;
+    if (val == val)
+        std::memcpy(&bits, &val, sizeof(bits));
+    return Value(bits, 0);
+}
+
+template <class T, class... Args>
+inline Value Value::make(Args&&... args) {
+    return Value(new T(std::forward<Args>(args)...));
+}
+
+inline Value::operator bool() const {
+    return bits != boxed(EMPTY, 0);
+}
+
+inline bool Value::operator==(const Value& other) const {
+    return bits == other.bits;
+}
+
+inline bool Value::operator!=(const Value& other) const {
+    return bits != other.bits;
+}
+
+inline Value* Value::operator->() {
+    return this;
+}
+
+inline const Value* Value::operator->() const {
+    return this;
+}
+
+inline Value::Tag Value::tag() const {
+    if ((bits & BOX) != BOX)
+        return REAL;
+    return static_cast<Tag>((bits >> 48) & 0x7);
+}
+
+inline bool Value::isNil() const {
+    return bits == boxed(NONE, 0);
+}
+
+inline bool Value::isr() const {
+    return (bits & BOX) != BOX;
+}
+
+inline bool Value::isi() const {
+    Object* obj = object();
+    return (bits & ~PAYLOAD) == boxed(INT, 0) || (obj && obj->kind == Object::INTEGER);
+}
+
+inline bool Value::iss() const {
+    Object* obj = object();
+    return (bits & ~PAYLOAD) == boxed(STR, 0) || (obj && obj->kind == Object::STRING);
+}
+
+inline bool Value::ist() const {
+    Object* obj = object();
+    return obj && obj->kind == Object::TABLE;
+}
+
+inline bool Value::isb() const {
+    return (bits & ~PAYLOAD) == boxed(BOOL, 0);
+}
+
+inline Object* Value::object() const {
+    if ((bits & ~PAYLOAD) != boxed(OBJECT, 0))
+        return nullptr;
+    return reinterpret_cast<Object*>(static_cast<uintptr_t>(bits & PAYLOAD));
+}
+
+template <class T>
+inline bool Value::is() const {
+    Object* obj = object();
+    return obj && obj->kind == T::KIND;
+}
+
+template <class T>
+inline T& Value::as() const {
+    return static_cast<T&>(*object());
+}
+
+inline oca_real Value::tor() const {
+    if (!isr())
+        return 0.0;
+    oca_real val;
+    std::memcpy(&val, &bits, sizeof(val));
+    return val;
+}
+
+inline bool Value::tob() const {
+    return isb() && (bits & 1);
+}
+
+OCA_END
@@ -13,7 +13,6 @@
 #define OCA_BEGIN namespace oca {
 #define OCA_END }
 #define DLLEXPORT __declspec(dllexport) void
-#define TYPE_EQ(a, b) (typeid(a) == typeid(b))
 
 OCA_BEGIN
 
@@ -22,20 +21,27 @@ class Lexer;
 class Expression;
 class Parser;
 class Value;
+class Object;
 class Scope;
 class Evaluator;
 class ErrorHandler;
 class State;
 struct Arg;
+struct Completion;
 class ValueCast;
+template <class T>
+class Ref;
 
 typedef unsigned int uint;
-typedef std::shared_ptr<Expression> ExprPtr;
-typedef std::shared_ptr<Value> ValuePtr;
+typedef Ref<Expression> ExprPtr;
+// the embedding api kept its pointer name when values became handles
+typedef Value ValuePtr;
 typedef void (*DLLfunc)(Scope&);
-typedef ValuePtr Ret;
+typedef Value Ret;
 typedef std::function<Ret(Arg)> CPPFunc;
 
 #define CPPFUNC (oca::Arg arg) mutable -> oca::Ret
 
 OCA_END
+
+#include "ref.hpp"
@@ -147,6 +147,16 @@ ErrorInfo ErrorHandler::getParseErrorInfo(const Error& error) const {
                 static_cast<uint>(tokens->at(tokenIndex - 1).val.size()),
                 "'if' must have the 'then' keyword.", "NO THEN"};
 
+    case NO_DO:
+        return {tokens->at(tokenIndex - 1).pos,
+                static_cast<uint>(tokens->at(tokenIndex - 1).val.size()),
+                "A loop must have the 'do' keyword.", "NO DO"};
+
+    case NO_IN:
+        return {tokens->at(tokenIndex - 1).pos,
+                static_cast<uint>(tokens->at(tokenIndex - 1).val.size()),
+                "'for' must have the 'in' keyword.", "NO IN"};
+
     case NO_RIGHT_VALUE:
         return {tokens->at(tokenIndex - 1).pos,
                 static_cast<uint>(tokens->at(tokenIndex - 1).val.size()),
@@ -186,6 +196,16 @@ ErrorInfo ErrorHandler::getEvalErrorInfo(const Error& error) const {
                 static_cast<uint>(tokens->at(currentExpr->index).val.size()),
                 "The conditional for 'if' must evaluate to a boolean value.", "IF BOOL"};
 
+    case WHILE_BOOL:
+        return {tokens->at(currentExpr->index).pos,
+                static_cast<uint>(tokens->at(currentExpr->index).val.size()),
+                "The conditional for 'while' must evaluate to a boolean value.", "WHILE BOOL"};
+
+    case NOT_ITERABLE:
+        return {tokens->at(currentExpr->index).pos,
+                static_cast<uint>(tokens->at(currentExpr->index).val.size()),
+                "Only tables, ranges and strings can be looped over with 'for'.", "NOT ITERABLE"};
+
     case UNDEFINED_IN_TABLE:
         return {tokens->at(currentExpr->index).pos,
                 static_cast<uint>(tokens->at(currentExpr->index).val.size()),
@@ -217,6 +237,11 @@ ErrorInfo ErrorHandler::getEvalErrorInfo(const Error& error) const {
                 static_cast<uint>(tokens->at(currentExpr->index).val.size()),
                 "This is not a public member.", "NOT PUBLIC"};
 
+    case FROZEN_TABLE:
+        return {tokens->at(currentExpr->index).pos,
+                static_cast<uint>(tokens->at(currentExpr->index).val.size()),
+                "A frozen table cannot be changed.", "FROZEN TABLE"};
+
     case CUSTOM_ERROR:
         return {tokens->at(currentExpr->index).pos,
                 static_cast<uint>(tokens->at(currentExpr->index).val.size()), error.detail,
@@ -27,6 +27,8 @@ enum ErrorType {
     NO_ACCESS_KEY_CALL,
     NO_CONDITIONAL,
     NO_THEN,
+    NO_DO,
+    NO_IN,
     NO_RIGHT_VALUE,
     NOTHING_TO_INJECT,
 
@@ -35,12 +37,15 @@ enum ErrorType {
     CANNOT_SPLIT,
     UNDEFINED_OPERATOR,
     IF_BOOL,
+    WHILE_BOOL,
+    NOT_ITERABLE,
     UNDEFINED_IN_TABLE,
     NO_ARGUMENT,
     SMALL_TABLE,
     UNDEFINED,
     TYPE_MISMATCH,
     NOT_PUBLIC,
+    FROZEN_TABLE,
     CUSTOM_ERROR
 };
 
@@ -15,17 +15,19 @@ OCA_BEGIN
 
 Evaluator::Evaluator(State* state) : state(state), current(nullptr) {}
 
-ValuePtr Evaluator::eval(ExprPtr expr, Scope& scope) {
+Value Evaluator::eval(ExprPtr expr, Scope& scope) {
     if (expr == nullptr)
-        return Nil::in(&scope);
+        return NIL;
     else if (expr->type == Expression::SET)
         return set(expr, scope);
     else if (expr->type == Expression::CALL)
-        return call(expr, scope);
+        return call(expr, scope, false).value;
     else if (expr->type == Expression::IF)
-        return cond(expr, scope);
+        return settle(cond(expr, scope, false)).value;
+    else if (expr->type == Expression::WHILE || expr->type == Expression::FOR)
+        return settle(loop(expr, scope)).value;
     else if (expr->type == Expression::ACCESS)
-        return access(expr, scope);
+        return access(expr, scope, false).value;
     else if (expr->type == Expression::OPER)
         return oper(expr, scope);
     else if (expr->type == Expression::FILE)
@@ -34,9 +36,61 @@ ValuePtr Evaluator::eval(ExprPtr expr, Scope& scope) {
         return value(expr, scope);
 }
 
+Completion Evaluator::exec(ExprPtr expr, Scope& scope, bool tail) {
+    if (expr->type == Expression::RETURN) {
+        if (!expr->right)
+            return {Completion::RETURN, NIL};
+        // the returned expression is always in tail position
+        Completion result = exec(expr->right, scope, true);
+        if (result.type == Completion::NORMAL)
+            result.type = Completion::RETURN;
+        return result;
+    } else if (expr->type == Expression::BREAK)
+        return {Completion::BREAK, nullptr};
+    else if (expr->type == Expression::IF)
+        return cond(expr, scope, tail);
+    else if (expr->type == Expression::WHILE || expr->type == Expression::FOR)
+        return loop(expr, scope);
+    else if (expr->type == Expression::CALL)
+        return call(expr, scope, tail);
+    else if (expr->type == Expression::ACCESS)
+        return access(expr, scope, tail);
+    else
+        return {Completion::NORMAL, eval(expr, scope)};
+}
+
+Completion Evaluator::run(ExprPtr body, Scope& scope, bool tail) {
+    Completion result = {Completion::NORMAL, nullptr};
+    while (body && body->left) {
+        Completion next = exec(body->left, scope, tail && !body->right);
+        // a break carries the value of the last statement before it
+        if (next.type == Completion::BREAK && !next.value)
+            next.value = result.value;
+        result = next;
+        if (result.type != Completion::NORMAL)
+            break;
+        body = body->right;
+    }
+    if (!result.value && result.type != Completion::BREAK)
+        result.value = NIL;
+    return result;
+}
+
+Completion Evaluator::settle(Completion completion) {
+    if (completion.type == Completion::BREAK && !completion.value)
+        completion.value = NIL;
+    if (completion.type != Completion::TAIL)
+        return completion;
+
+    TailCall call = std::move(tail);
+    tail = {};
+    Block& block = call.block.as<Block>();
+    return {Completion::RETURN, block(call.caller, call.arg, call.yield)};
+}
+
 // ----------------------------
 
-ValuePtr Evaluator::set(ExprPtr expr, Scope& scope) {
+Value Evaluator::set(ExprPtr expr, Scope& scope) {
     auto tracker = current;
     current = expr;
 
@@ -53,30 +107,31 @@ ValuePtr Evaluator::set(ExprPtr expr, Scope& scope) {
         lefts.push_back(it);
     }
 
-    ValuePtr rightVal = eval(expr->right, scope);
+    Value rightVal = eval(expr->right, scope);
     if (any) {
-        scope.add(rightVal->scope);
+        if (rightVal.ist())
+            scope.add(rightVal.as<Table>().scope);
     } else {
-        uint counter = ARRAY_BEGIN_INDEX;
+        oca_int counter = 0;
         for (auto& leftExpr : lefts) {
-            std::string name = leftExpr->val;
-            ValuePtr leftVal = Nil::in(&scope);
-
-            if (leftExpr->type == Expression::ACCESS) {
-                leftVal = eval(leftExpr, scope);
-                if (leftVal->isNil())
-                    throw Error(NEW_TABLE_KEY);
-                name = leftVal->scope.parent->get(leftVal);
-            }
-            if (lefts.size() == 1)
-                leftVal->scope.parent->set(name, rightVal, pub);
-            else {
-                ValuePtr rightValPart = rightVal->scope.get(std::to_string(counter), false);
+            Value part = rightVal;
+            if (lefts.size() > 1) {
+                part = rightVal->item(counter);
                 ++counter;
-                if (rightValPart->isNil())
+                if (part->isNil())
                     throw Error(CANNOT_SPLIT);
-                leftVal->scope.parent->set(name, rightValPart, pub);
             }
+
+            if (leftExpr->type == Expression::ACCESS) {
+                // assign into the table the access points at
+                Value table = eval(leftExpr->left, scope);
+                bool super = leftExpr->left->val == "super";
+                std::string name = leftExpr->right->val;
+                if (!table.ist() || table.as<Table>().get(name, super).isNil())
+                    throw Error(NEW_TABLE_KEY);
+                table.as<Table>().set(name, part, pub);
+            } else
+                scope.set(leftExpr->val, part, pub);
         }
     }
 
@@ -84,11 +139,11 @@ ValuePtr Evaluator::set(ExprPtr expr, Scope& scope) {
     return rightVal;
 }
 
-ValuePtr Evaluator::call(ExprPtr expr, Scope& scope) {
+Completion Evaluator::call(ExprPtr expr, Scope& scope, bool tail) {
     auto tracker = current;
     current = expr;
 
-    ValuePtr val = state->global.get(expr->val, true);
+    Value val = state->global.get(expr->val, true);
     Scope* searchScope = &scope;
     while (val->isNil()) {
         val = searchScope->get(expr->val, true);
@@ -97,20 +152,23 @@ ValuePtr Evaluator::call(ExprPtr expr, Scope& scope) {
         searchScope = searchScope->parent;
     }
 
-    ValuePtr arg = eval(expr->right, scope);
-    ValuePtr block = eval(expr->left, scope);
+    if (!val.is<Func>() && !val.is<Block>()) {
+        current = tracker;
+        return {Completion::NORMAL, val};
+    }
 
-    Value& vref = *val;
-    ValuePtr result = val;
-    if (TYPE_EQ(vref, Func))
-        result = static_cast<Func&>(vref)(Table::from(scope), arg, block);
-    if (TYPE_EQ(vref, Block))
-        result = static_cast<Block&>(vref)(Table::from(scope), arg, block);
+    Value caller = self(scope);
+    Completion result;
+    if (!direct(val, caller, expr, scope, result)) {
+        Value arg = eval(expr->right, scope);
+        Value block = eval(expr->left, scope);
+        result = invoke(val, caller, arg, block, caller, tail);
+    }
     current = tracker;
     return result;
 }
 
-ValuePtr Evaluator::oper(ExprPtr expr, Scope& scope) {
+Value Evaluator::oper(ExprPtr expr, Scope& scope) {
     auto tracker = current;
     current = expr;
 
@@ -120,85 +178,207 @@ ValuePtr Evaluator::oper(ExprPtr expr, Scope& scope) {
         {">=", "__geq"},  {"<=", "__leq"},  {"..", "__ran"}, {"and", "__and"}, {"or", "__or"},
         {"xor", "__xor"}, {"lsh", "__lsh"}, {"rsh", "__rsh"}};
 
-    ValuePtr left = eval(expr->left, scope);
-    ValuePtr right = eval(expr->right, scope);
-    ValuePtr func = left->scope.get(operFuncs[expr->val], false);
+    Value left = eval(expr->left, scope);
+    Value right = eval(expr->right, scope);
+    Value func = state->methods.get(left, operFuncs[expr->val], false);
     if (func->isNil())
         throw Error(UNDEFINED_OPERATOR);
 
-    Value& funcref = *func;
-    ValuePtr result = func;
-    if (TYPE_EQ(funcref, Func))
-        result = static_cast<Func&>(funcref)(left, right, Nil::in(&scope));
-    if (TYPE_EQ(funcref, Block))
-        result = static_cast<Block&>(funcref)(left, right, Nil::in(&scope));
+    Value result = invoke(func, left, right, NIL, NIL, false).value;
 
     current = tracker;
     return result;
 }
 
-ValuePtr Evaluator::cond(ExprPtr expr, Scope& scope) {
+Completion Evaluator::cond(ExprPtr expr, Scope& scope, bool tail) {
     auto tracker = current;
     current = expr;
 
-    ValuePtr conditional = eval(expr->left, scope);
-    Value& cref = *conditional;
-    if (!(TYPE_EQ(cref, Bool)))
+    Value conditional = eval(expr->left, scope);
+    if (!conditional.isb())
         throw Error(IF_BOOL);
-    bool trueness = static_cast<Bool&>(cref).val;
+    bool trueness = conditional.tob();
     current = tracker;
 
-    ValuePtr branch = Nil::in(&scope);
-    if (trueness)
-        branch = eval(expr->right->left, scope);
-    else if (expr->right->right)
-        branch = eval(expr->right->right, scope);
-
-    if (branch->isNil())
-        return branch;
+    ExprPtr branch = (trueness) ? expr->right->left : expr->right->right;
+    if (!branch)
+        return {Completion::NORMAL, NIL};
 
     auto temp = Scope(&scope);
-    ValuePtr result = Nil::in(&temp);
-    ExprPtr it = static_cast<Block&>(*branch).val;
-    while (it && it->left) {
-        if (it->left->type == Expression::RETURN) {
-            returning = true;
-            result = eval(it->left->right, temp);
-            break;
+    return run(branch, temp, tail);
+}
+
+Completion Evaluator::loop(ExprPtr expr, Scope& scope) {
+    auto tracker = current;
+    current = expr;
+
+    // one frame for the whole loop, so locals carry over between iterations
+    Scope frame(&scope);
+    Completion result = {Completion::NORMAL, NIL};
+
+    if (expr->type == Expression::WHILE) {
+        while (true) {
+            current = expr;
+            Value conditional = eval(expr->left, frame);
+            if (!conditional->isb())
+                throw Error(WHILE_BOOL);
+            current = tracker;
+            if (!conditional->tob() || !iterate(expr->right, frame, result))
+                break;
         }
-        if (it->left->type == Expression::BREAK)
-            break;
-        result = eval(it->left, temp);
-        it = it->right;
+        return result;
     }
+
+    // set the loop variables up once and only swap their values
+    uint params = 1;
+    for (char c : expr->val)
+        if (c == ' ')
+            ++params;
+    if (params > 2)
+        throw Error(CANNOT_SPLIT);
+    std::string names = expr->val;
+    std::string first = names.substr(0, names.find(' '));
+    frame.set(first, NIL, true);
+    if (params == 2)
+        frame.set(names.substr(names.find(' ') + 1), NIL, true);
+
+    auto bind = [&](Value key, Value value) {
+        if (params == 1)
+            frame.vars[0].bind(value);
+        else {
+            frame.vars[0].bind(key);
+            frame.vars[1].bind(value);
+        }
+    };
+
+    Value iterable = eval(expr->left, scope);
+    if (iterable->ist()) {
+        auto& table = iterable.as<Table>();
+        current = tracker;
+        for (oca_int i = 0; i < table.length(); ++i) {
+            bind(Value::integer(i + ARRAY_BEGIN_INDEX), table.item(i));
+            if (!iterate(expr->right, frame, result))
+                return result;
+        }
+        for (uint i = 0; i < table.scope.vars.size(); ++i) {
+            Value value = table.scope.vars[i].get();
+            if (!value || value.is<Func>())
+                continue;
+            bind(Value::string(table.scope.name(i)), value);
+            if (!iterate(expr->right, frame, result))
+                break;
+        }
+    } else if (iterable.is<Range>()) {
+        auto& range = iterable.as<Range>();
+        current = tracker;
+        for (oca_int i = 0; i < range.length(); ++i) {
+            bind(Value::integer(i), Value::integer(range.begin + i));
+            if (!iterate(expr->right, frame, result))
+                break;
+        }
+    } else if (iterable->iss()) {
+        std::string_view str = iterable.view();
+        current = tracker;
+        for (uint i = 0; i < str.size(); ++i) {
+            bind(Value::integer(i), Value::string(str.substr(i, 1)));
+            if (!iterate(expr->right, frame, result))
+                break;
+        }
+    } else
+        throw Error(NOT_ITERABLE);
+
     return result;
 }
 
-ValuePtr Evaluator::access(ExprPtr expr, Scope& scope) {
+// loop iterations let the cycle collector run once enough suspects piled up
+void Evaluator::safepoint() {
+    if (state->pool->pressing())
+        state->pool->automatic();
+}
+
+bool Evaluator::iterate(ExprPtr body, Scope& frame, Completion& result) {
+    safepoint();
+    Completion next = run(body, frame);
+    if (next.type == Completion::BREAK) {
+        if (next.value)
+            result.value = next.value;
+        return false;
+    }
+    result = next;
+    return result.type == Completion::NORMAL;
+}
+
+Completion Evaluator::access(ExprPtr expr, Scope& scope, bool tail) {
     auto tracker = current;
     current = expr->right;
 
-    ValuePtr left = eval(expr->left, scope);
+    Value left = eval(expr->left, scope);
     bool super = expr->left->val == "super";
-    ValuePtr right = left->scope.get(expr->right->val, super);
+    Value right = state->methods.get(left, expr->right->val, super);
     if (right->isNil())
         throw Error(UNDEFINED_IN_TABLE);
 
-    ValuePtr arg = eval(expr->right->right, scope);
-    ValuePtr block = eval(expr->right->left, scope);
-
-    Value& val = *right;
-    ValuePtr result = right;
-    if (TYPE_EQ(val, Func))
-        result = static_cast<Func&>(val)(left, arg, block);
-    if (TYPE_EQ(val, Block))
-        result = static_cast<Block&>(val)(left, arg, block);
-
+    Completion result;
+    if (!direct(right, left, expr->right, scope, result)) {
+        Value arg = eval(expr->right->right, scope);
+        Value block = eval(expr->right->left, scope);
+        // only a yield block of a native needs the self of this scope
+        Value outer = (right.is<Func>() && block.is<Block>()) ? self(scope) : NIL;
+        result = invoke(right, left, arg, block, outer, tail);
+    }
     current = tracker;
     return result;
 }
 
-ValuePtr Evaluator::file(ExprPtr expr, Scope& scope) {
+Completion Evaluator::invoke(Value val, Value caller, Value arg, Value block, Value self,
+    bool tail) {
+    if (val.is<Func>())
+        return {Completion::NORMAL, val.as<Func>()(caller, arg, block, self)};
+    if (val.is<Block>()) {
+        if (tail) {
+            this->tail = {val, caller, arg, block};
+            return {Completion::TAIL, nullptr};
+        }
+        return {Completion::NORMAL, val.as<Block>()(caller, arg, block)};
+    }
+    return {Completion::NORMAL, val};
+}
+
+bool Evaluator::direct(Value func, Value caller, ExprPtr expr, Scope& scope, Completion& result) {
+    // a native function with several parameters gets a written list of
+    // plain arguments as it is, without a table made for it
+    if (!func.is<Func>() || !func.as<Func>().spreads() || func.as<Func>().arity() < 2)
+        return false;
+    ExprPtr list = expr->right;
+    if (!list || list->type != Expression::TABL || !list->right)
+        return false;
+    uint argc = 0;
+    for (ExprPtr it = list; it && it->left; it = it->right) {
+        if (it->val != "" || it->left->type == Expression::BLOCK || ++argc > Func::SPREAD)
+            return false;
+    }
+
+    Value args[Func::SPREAD];
+    argc = 0;
+    for (ExprPtr it = list; it && it->left; it = it->right)
+        args[argc++] = eval(it->left, scope);
+    Value block = eval(expr->left, scope);
+    Value outer = (block.is<Block>()) ? self(scope) : NIL;
+    result = {Completion::NORMAL, func.as<Func>()(caller, args, argc, block, outer)};
+    return true;
+}
+
+Value Evaluator::self(Scope& scope) {
+    // plain calls keep the self of the calling block
+    for (Scope* it = &scope; it; it = it->parent) {
+        Value val = it->get("self", true);
+        if (!val->isNil())
+            return val;
+    }
+    return Table::from(scope);
+}
+
+Value Evaluator::file(ExprPtr expr, Scope& scope) {
     auto oldPath = state->eh.path;
     auto oldSource = state->eh.source;
     auto oldTokens = state->eh.tokens;
@@ -222,64 +402,67 @@ ValuePtr Evaluator::file(ExprPtr expr, Scope& scope) {
     return val;
 }
 
-ValuePtr Evaluator::value(ExprPtr expr, Scope& scope) {
+Value Evaluator::value(ExprPtr expr, Scope& scope) {
     auto tracker = current;
     current = expr;
 
-    ValuePtr result = Nil::in(&scope);
+    Value result = NIL;
     if (expr->type == Expression::TABL) {
         if (expr->right == nullptr && expr->val == "")
             return eval(expr->left, scope);
 
-        result = std::make_shared<Table>(&scope);
-        uint counter = ARRAY_BEGIN_INDEX;
+        result = Value::make<Table>(&scope);
+        auto& table = result.as<Table>();
         while (expr && expr->left) {
-            std::string nam = "";
             bool pub = (expr->val.find("pub ") != std::string::npos);
             bool any = (expr->val.find("*") != std::string::npos);
 
             if (!any) {
-                if (expr->val == "") {
-                    pub = true;
-                    nam = std::to_string(counter);
-                    ++counter;
-                    ++static_cast<Table&>(*result).count;
-                }
-                if (pub && expr->val != "")
-                    nam = expr->val.substr(4);
-                if (nam == "")
-                    nam = expr->val;
-                ++static_cast<Table&>(*result).size;
-                result->scope.set(nam, eval(expr->left, scope), pub);
+                // blocks written in a table see its members
+                Value member = (expr->left->type == Expression::BLOCK)
+                                      ? Value::make<Block>(expr->left, &table.scope, this)
+                                      : eval(expr->left, scope);
+                if (expr->val == "")
+                    table.push(member);
+                else
+                    table.set(pub ? expr->val.substr(4) : expr->val, member, pub);
             } else {
-                result->scope.add(eval(expr->left, scope)->scope);
+                Value base = eval(expr->left, scope);
+                if (base.ist()) {
+                    Table& from = base.as<Table>();
+                    for (oca_int i = 0; i < from.length(); ++i)
+                        table.push(from.item(i));
+                    table.scope.add(from.scope);
+                    table.rebind(from.scope);
+                }
             }
 
             expr = expr->right;
         }
+        table.scope.parent = nullptr;
     } else if (expr->type == Expression::EMPTY_TABL) {
-        result = std::make_shared<Table>(&scope);
+        result = Value::make<Table>();
     } else if (
         expr->type == Expression::BLOCK || expr->type == Expression::MAIN ||
         expr->type == Expression::ELSE) {
-        result = std::make_shared<Block>(expr, &scope, this);
+        result = Value::make<Block>(expr, &scope, this);
     } else if (expr->type == Expression::STR) {
-        result = std::make_shared<String>(expr->val, &scope);
+        result = Value::string(expr->val);
     } else if (expr->type == Expression::FSTR) {
         result = fstring(expr, scope);
     } else if (expr->type == Expression::INT) {
-        result = std::make_shared<Integer>(std::stoll(expr->val), &scope);
+        result = Value::integer(std::stoll(expr->val));
     } else if (expr->type == Expression::REAL) {
-        result = std::make_shared<Real>(std::stod(expr->val), &scope);
+        result = Value::real(std::stod(expr->val));
     } else if (expr->type == Expression::BOOL) {
-        result = std::make_shared<Bool>(expr->val == "true", &scope);
+        result = Value::boolean(expr->val == "true");
     }
 
     current = tracker;
     return result;
 }
 
-ValuePtr Evaluator::fstring(ExprPtr expr, Scope& scope) {
+Value Evaluator::fstring(ExprPtr expr, Scope& scope) {
     std::string string = expr->val;
     std::string formatted = "";
 
@@ -323,7 +506,7 @@ ValuePtr Evaluator::fstring(ExprPtr expr, Scope& scope) {
         }
     }
 
-    return std::make_shared<String>(formatted, &scope);
+    return Value::string(formatted);
 }
 
 OCA_END
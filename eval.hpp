@@ -8,27 +8,53 @@
 #include <memory>
 #include <string>
 #include "common.hpp"
+#include "box.hpp"
 
 OCA_BEGIN
 
+// how a statement finished, non-local exits are passed up as values
+struct Completion {
+    enum Type { NORMAL, RETURN, BREAK, TAIL };
+
+    Type type;
+    Value value;
+};
+
+// block call left for the caller's frame to make
+struct TailCall {
+    Value block;
+    Value caller;
+    Value arg;
+    Value yield;
+};
+
 class Evaluator {
 public:
     State* state;
     ExprPtr current;
-    bool returning = false;
+    TailCall tail;
 
     explicit Evaluator(State* state);
-    ValuePtr eval(ExprPtr expr, Scope& scope);
+    Value eval(ExprPtr expr, Scope& scope);
+    Completion exec(ExprPtr expr, Scope& scope, bool tail = false);
+    Completion run(ExprPtr body, Scope& scope, bool tail = false);
+    Completion settle(Completion completion);
+    void safepoint();
 
 private:
-    ValuePtr set(ExprPtr expr, Scope& scope);
-    ValuePtr call(ExprPtr expr, Scope& scope);
-    ValuePtr oper(ExprPtr expr, Scope& scope);
-    ValuePtr cond(ExprPtr expr, Scope& scope);
-    ValuePtr access(ExprPtr expr, Scope& scope);
-    ValuePtr file(ExprPtr expr, Scope& scope);
-    ValuePtr value(ExprPtr expr, Scope& scope);
-    ValuePtr fstring(ExprPtr expr, Scope& scope);
+    Value set(ExprPtr expr, Scope& scope);
+    Completion call(ExprPtr expr, Scope& scope, bool tail);
+    Value oper(ExprPtr expr, Scope& scope);
+    Completion cond(ExprPtr expr, Scope& scope, bool tail);
+    Completion loop(ExprPtr expr, Scope& scope);
+    bool iterate(ExprPtr body, Scope& frame, Completion& result);
+    Completion access(ExprPtr expr, Scope& scope, bool tail);
+    Completion invoke(Value val, Value caller, Value arg, Value block, Value self, bool tail);
+    bool direct(Value func, Value caller, ExprPtr expr, Scope& scope, Completion& result);
+    Value self(Scope& scope);
+    Value file(ExprPtr expr, Scope& scope);
+    Value value(ExprPtr expr, Scope& scope);
+    Value fstring(ExprPtr expr, Scope& scope);
 };
 
 OCA_END
@@ -54,7 +54,7 @@ class Lexer {
         {Token::INTEGER, "[0-9]+"},
         {Token::BOOLEAN, "\\b(true|false)\\b"},
         {Token::FILEPATH, "\\$.+"},
-        {Token::KEYWORD, "\\b(do|if|then|else|return|break|with|pub)\\b"},
+        {Token::KEYWORD, "\\b(do|if|then|else|while|for|in|return|break|with|pub)\\b"},
         {Token::OPERATOR, "\\+|-|\\*|\\/|%|\\^|<=|>=|==|!=|<|>|\\.\\.|and|or|xor|lsh|rsh"},
         {Token::NAME, "[A-Za-z_][A-Za-z_0-9]*"},
         {Token::PUNCTUATION, "\\.|:|\\(|\\)|,|="},
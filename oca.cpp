@@ -16,16 +16,19 @@
 
 OCA_BEGIN
 
-ValuePtr Arg::operator[](uint i) {
-    return value->scope.get(std::to_string(i), false);
+Value Arg::operator[](uint i) {
+    if (args)
+        return (i < argc) ? args[i] : NIL;
+    return value->item(i);
 }
 
 // ---------------------------------------
 
 State::State()
-    : global(nullptr), scope(nullptr), evaler(this), eh(this), lextime(0), parsetime(0),
-      evaltime(0) {
+    : pool(Pool::open()), global(nullptr), scope(nullptr), methods(pool.get()), evaler(this),
+      eh(this), lextime(0), parsetime(0), evaltime(0) {
     begin = std::chrono::high_resolution_clock::now();
+    Pool::Use use(pool.get());
 
     bind("print", "a", [&] CPPFUNC {
         std::cout << arg.value->tos();
@@ -38,15 +41,17 @@ State::State()
     });
 
     bind("debug", "a", [&] CPPFUNC {
-        std::cout << arg.value->tos() << " of type " << arg.value->typestr() << " at "
-                  << arg.value.get() << "\n";
+        std::cout << arg.value->tos() << " of type " << arg.value->typestr();
+        if (arg.value.object())
+            std::cout << " at " << arg.value.object();
+        std::cout << "\n";
         return NIL;
     });
 
     bind("input", "", [&] CPPFUNC {
         std::string result;
         std::cin >> result;
-        return cast(result);
+        return cast(std::move(result));
     });
 
     bind("pause", "", [&] CPPFUNC {
@@ -60,7 +65,7 @@ State::State()
         if (!cond)
             throw Error(CUSTOM_ERROR, message);
         return NIL;
-    });
+    }, true);
 
     bind("error", "s", [&] CPPFUNC {
         std::string message = arg.value->tos();
@@ -70,57 +75,54 @@ State::State()
 
     bind("type", "a", [&] CPPFUNC {
         std::string str = arg.value->typestr();
-        return cast(str);
+        return cast(std::move(str));
     });
 
     bind("abs", "n", [&] CPPFUNC {
-        if (arg.value->isi()) {
-            auto& val = static_cast<Integer&>(*arg.value);
-            return cast(std::abs(val.val));
-        } else {
-            auto& val = static_cast<Real&>(*arg.value);
-            return cast(std::abs(val.val));
-        }
+        if (arg.value->isi())
+            return cast(std::abs(arg.value->toi()));
+        else
+            return cast(std::abs(arg.value->tor()));
     });
 
     bind("acos", "r", [&] CPPFUNC {
-        auto& val = static_cast<Real&>(*arg.value);
-        return cast(std::acos(val.val));
+        oca_real val = arg.value->tor();
+        return cast(std::acos(val));
     });
 
     bind("asin", "r", [&] CPPFUNC {
-        auto& val = static_cast<Real&>(*arg.value);
-        return cast(std::asin(val.val));
+        oca_real val = arg.value->tor();
+        return cast(std::asin(val));
     });
 
     bind("atan", "r", [&] CPPFUNC {
-        auto& val = static_cast<Real&>(*arg.value);
-        return cast(std::atan(val.val));
+        oca_real val = arg.value->tor();
+        return cast(std::atan(val));
     });
 
     bind("acot", "r", [&] CPPFUNC {
-        auto& val = static_cast<Real&>(*arg.value);
-        return cast(std::atan(1 / val.val));
+        oca_real val = arg.value->tor();
+        return cast(std::atan(1 / val));
     });
 
     bind("cos", "r", [&] CPPFUNC {
-        auto& val = static_cast<Real&>(*arg.value);
-        return cast(std::cos(val.val));
+        oca_real val = arg.value->tor();
+        return cast(std::cos(val));
     });
 
     bind("sin", "r", [&] CPPFUNC {
-        auto& val = static_cast<Real&>(*arg.value);
-        return cast(std::sin(val.val));
+        oca_real val = arg.value->tor();
+        return cast(std::sin(val));
     });
 
     bind("tan", "r", [&] CPPFUNC {
-        auto& val = static_cast<Real&>(*arg.value);
-        return cast(std::tan(val.val));
+        oca_real val = arg.value->tor();
+        return cast(std::tan(val));
     });
 
     bind("cot", "r", [&] CPPFUNC {
-        auto& val = static_cast<Real&>(*arg.value);
-        return cast(1 / std::tan(val.val));
+        oca_real val = arg.value->tor();
+        return cast(1 / std::tan(val));
     });
 
     bind("max", "nn", [&] CPPFUNC {
@@ -133,7 +135,7 @@ State::State()
                 throw Error(CUSTOM_ERROR, "Expected similar types.");
             return cast(std::fmax(arg[0]->tor(), arg[1]->tor()));
         }
-    });
+    }, true);
 
     bind("min", "nn", [&] CPPFUNC {
         if (arg[0]->isi()) {
@@ -145,7 +147,7 @@ State::State()
                 throw Error(CUSTOM_ERROR, "Expected similar types.");
             return cast(std::fmin(arg[0]->tor(), arg[1]->tor()));
         }
-    });
+    }, true);
 
     bind("rad", "r", [&] CPPFUNC {
         oca_real halfc = 3.14159265358979323846 / 180.0;
@@ -163,7 +165,7 @@ State::State()
         oca_real base = arg[0]->tor();
         oca_real x = arg[1]->tor();
         return cast(std::log(x) / std::log(base));
-    });
+    }, true);
 
     bind("ln", "r", [&] CPPFUNC {
         oca_real x = arg.value->tor();
@@ -199,7 +201,7 @@ State::State()
         std::string string(begin, end);
         file.close();
 
-        return cast(string);
+        return cast(std::move(string));
     });
 
     bind("write", "ss", [&] CPPFUNC {
@@ -212,7 +214,7 @@ State::State()
         file.close();
 
         return NIL;
-    });
+    }, true);
 
     bind("date", "", [&] CPPFUNC {
         auto now = std::chrono::system_clock::now();
@@ -262,7 +264,7 @@ State::~State() {
     #endif
 }
 
-ValuePtr State::runFile(const std::string& path) {
+Value State::runFile(const std::string& path) {
     std::ifstream file(path);
     if (!file.is_open())
         std::cout << "Could not open file " << path << "\n";
@@ -275,10 +277,14 @@ ValuePtr State::runFile(const std::string& path) {
     return runString(source);
 }
 
-ValuePtr State::runString(const std::string& source) {
+Value State::runString(const std::string& source) {
+    Pool::Use use(pool.get());
+    // the error handler points at the tokens, so they live until it is done
+    std::vector<Token> tokens;
     try {
         eh.source = &source;
-        auto tokens = lex(source);
+        tokens = lex(source);
+        eh.tokens = &tokens;
         auto ast = parse(tokens);
         return evaluate(ast);
     } catch (Error& e) {
@@ -323,7 +329,28 @@ void State::runREPL() {
 // ---------------------------------------
 
 void State::bind(const std::string& name, const std::string& params, CPPFunc func) {
-    global.set(name, std::make_shared<Func>(func, params, &global), true);
+    bind(name, params, func, false);
+}
+
+void State::bind(const std::string& name, const std::string& params, CPPFunc func, bool spread) {
+    Pool::Use use(pool.get());
+    global.set(name, Value::make<Func>(func, params, spread), true);
+}
+
+const PoolStats& State::allocations() const {
+    return pool->stats;
+}
+
+const CollectorStats& State::collector() const {
+    return pool->collector;
+}
+
+size_t State::collect() {
+    return pool->collect(true);
+}
+
+size_t State::step(size_t budget) {
+    return pool->collect(false, budget);
 }
 
 // ---------------------------------------
@@ -334,7 +361,6 @@ std::vector<Token> State::lex(const std::string& source) {
     #endif
 
     auto tokens = lexer.tokenize(source);
-    eh.tokens = &tokens;
 
     #ifdef OUT_TIMES
     auto lend = std::chrono::high_resolution_clock::now();
@@ -373,7 +399,7 @@ std::vector<ExprPtr> State::parse(const std::vector<Token>& tokens) {
     return ast;
 }
 
-ValuePtr State::evaluate(const std::vector<ExprPtr>& ast) {
+Value State::evaluate(const std::vector<ExprPtr>& ast) {
     #ifdef OUT_VALUES
     std::cout << "------------ EVAL ------------\n";
     #endif
@@ -382,13 +408,18 @@ ValuePtr State::evaluate(const std::vector<ExprPtr>& ast) {
     auto estart = std::chrono::high_resolution_clock::now();
     #endif
 
-    ValuePtr val = nullptr;
+    Value val = nullptr;
     for (ExprPtr e : ast) {
-        val = evaler.eval(e, scope);
+        evaler.safepoint();
+        Completion c = evaler.settle(evaler.exec(e, scope));
+        val = c.value;
 
         #ifdef OUT_VALUES
         std::cout << "->" << val->tos() << "\n";
         #endif
+
+        if (c.type != Completion::NORMAL)
+            break;
     }
 
     #ifdef OUT_TIMES
@@ -7,28 +7,41 @@
 
 #include <chrono>
 #include "common.hpp"
+#include "pool.hpp"
 #include "lex.hpp"
 #include "scope.hpp"
 #include "value.hpp"
 #include "parse.hpp"
 #include "eval.hpp"
 #include "error.hpp"
+#include "utils.hpp"
 
-#define NIL oca::Nil::in(nullptr)
+#define NIL oca::Value::nil()
 
 OCA_BEGIN
 
+// a native function gets its argument in value, a table when there are
+// several. built-in and typed functions read them through operator[]
+// instead, so written argument lists come to them in args without a table
 struct Arg {
-    ValuePtr caller;
-    ValuePtr value;
-    ValuePtr yield;
+    Value caller;
+    Value value;
+    Value yield;
+    const Value* args = nullptr;
+    uint argc = 0;
+    // self where the call is written, the yield block of a native loop sees it
+    Value self;
 
-    ValuePtr operator[](uint i);
+    Value operator[](uint i);
 };
 
 class State {
+    // declared first so it is torn down after every value the State holds
+    PoolPtr pool;
+
     Scope global;
     Scope scope;
+    Methods methods;
 
     Lexer lexer;
     Parser parser;
@@ -46,29 +59,63 @@ public:
     State(const State&) = delete;
     State& operator=(const State&) = delete;
 
-    ValuePtr runFile(const std::string& path);
-    ValuePtr runString(const std::string& source);
+    Value runFile(const std::string& path);
+    Value runString(const std::string& source);
     void runREPL();
 
     void load(const std::string& lib);
     void bind(const std::string& name, const std::string& params, CPPFunc func);
+    // binds a c++ function or lambda, its parameter types give the checks
+    // and how arguments are unpacked, its result is cast into a value
+    template <class F>
+    void bind(const std::string& name, F func);
+    const PoolStats& allocations() const;
+    const CollectorStats& collector() const;
+
+    // frees values that only keep each other alive, step is a minor
+    // collection starting from no more than budget young suspects. the
+    // budget caps the suspects, not the work: each one is still traced
+    // through everything it reaches in the same call, so a suspect holding
+    // a big table makes for a long step
+    size_t collect();
+    size_t step(size_t budget);
 
 private:
+    void bind(const std::string& name, const std::string& params, CPPFunc func, bool spread);
     std::vector<Token> lex(const std::string& source);
     std::vector<ExprPtr> parse(const std::vector<Token>& tokens);
-    ValuePtr evaluate(const std::vector<ExprPtr>& ast);
+    Value evaluate(const std::vector<ExprPtr>& ast);
 
     friend class ErrorHandler;
     friend class Evaluator;
-    friend class Value;
-    friend class Integer;
-    friend class Real;
-    friend class String;
-    friend class Bool;
-    friend class Table;
     friend class Block;
-    friend class Func;
-    friend class Scope;
 };
 
+// calls a bound c++ function with its arguments unpacked
+template <class F, class... A, size_t... I>
+inline Value dispatch(F& func, Arg& arg, std::tuple<A...>*, std::index_sequence<I...>) {
+    using Result = typename Signature<F>::Result;
+    if constexpr (std::is_void_v<Result>) {
+        if constexpr (sizeof...(A) == 1)
+            func(unpack<A>(arg.value)...);
+        else
+            func(unpack<A>(arg[I])...);
+        return Value::nil();
+    } else if constexpr (sizeof...(A) == 1) {
+        return cast(func(unpack<A>(arg.value)...));
+    } else {
+        return cast(func(unpack<A>(arg[I])...));
+    }
+}
+
+template <class F>
+void State::bind(const std::string& name, F func) {
+    using Params = typename Signature<F>::Params;
+    Params* types = nullptr;
+    auto call = [func, types](Arg arg) mutable -> Ret {
+        return dispatch(func, arg, types, std::make_index_sequence<std::tuple_size_v<Params>>());
+    };
+    bind(name, params(types), call, true);
+}
+
 OCA_END
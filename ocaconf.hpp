@@ -9,6 +9,10 @@
 //#define OUT_AST
 //#define OUT_VALUES
 //#define OUT_TIMES
+// values and syntax trees count references without atomics, define this
+// to make only the counts atomic, pools, tables and strings are still not
+// safe to touch from more than one thread
+//#define OCA_ATOMIC_REFCOUNT
 typedef long long int oca_int;
 typedef double oca_real;
 #define ARRAY_BEGIN_INDEX 0
@@ -6,6 +6,7 @@
 #include <iostream>
 #include <fstream>
 #include <cmath>
+#include <algorithm>
 #include "oca.hpp"
 
 OCA_BEGIN
@@ -15,9 +16,10 @@ Expression::Expression(Expression::Type type, const std::string& val, uint index
 
 void Expression::print(uint indent, char mod) {
     std::vector<std::string> typestrings = {
-        "set",       "call", "access", "if",    "else",       "next", "main", "branches",
-        "part oper", "oper", "return", "break", "file",       "str",  "fstr", "int",
-        "real",      "bool", "block",  "tabl",  "empty tabl", "name", "calls"};
+        "set",  "call",   "access", "if",    "while", "for",  "else",       "next",
+        "main", "branches", "part oper", "oper", "return", "break", "file", "str",
+        "fstr", "int",    "real",   "bool",  "block", "tabl", "empty tabl", "name",
+        "calls"};
 
     for (uint i = 0; i < indent; i++)
         std::cout << "  ";
@@ -34,6 +36,7 @@ void Expression::print(uint indent, char mod) {
 std::vector<ExprPtr> Parser::makeAST(const std::vector<Token>& tokens) {
     index = 0;
     indent = 0;
+    noYield = false;
 
     this->tokens = &tokens;
     while (checkIndent(Indent::SAME))
@@ -77,7 +80,7 @@ ExprPtr Parser::uncache() {
 // ----------------------------
 
 bool Parser::expr() {
-    if (set() || call() || value() || block() || cond() || keyword() || file())
+    if (set() || call() || value() || block() || cond() || loop() || keyword() || file())
         return true;
     return false;
 }
@@ -106,7 +109,7 @@ bool Parser::set() {
         throw Error(NOTHING_TO_SET);
 
     // assemble assignment
-    ExprPtr expr = std::make_shared<Expression>(Expression::SET, pub ? "pub" : "", orig);
+    ExprPtr expr = ExprPtr::make(Expression::SET, pub ? "pub" : "", orig);
     expr->right = uncache();
     if (!any)
         expr->left = uncache();
@@ -122,12 +125,12 @@ bool Parser::call(bool inDot) {
         return false;
 
     bool hasArg = value() || call() || file();
-    bool hasYield = block();
+    bool hasYield = !noYield && block();
 
     ExprPtr yield = (hasYield) ? uncache() : nullptr;
     ExprPtr arg = (hasArg) ? uncache() : nullptr;
 
-    ExprPtr c = std::make_shared<Expression>(Expression::CALL, uncache()->val, orig);
+    ExprPtr c = ExprPtr::make(Expression::CALL, uncache()->val, orig);
     c->left = yield;
     c->right = arg;
     cache.push_back(c);
@@ -139,7 +142,7 @@ bool Parser::call(bool inDot) {
         uint origc = index;
         if (!call())
             throw Error(NO_NAME);
-        ExprPtr calls = std::make_shared<Expression>(Expression::CALLS, "", origc);
+        ExprPtr calls = ExprPtr::make(Expression::CALLS, "", origc);
         calls->right = uncache();
         calls->left = uncache();
         cache.push_back(calls);
@@ -161,7 +164,7 @@ bool Parser::access() {
         throw Error(NO_ACCESS_KEY);
 
     // assemble access
-    ExprPtr a = std::make_shared<Expression>(Expression::ACCESS, "", orig);
+    ExprPtr a = ExprPtr::make(Expression::ACCESS, "", orig);
     a->right = uncache();
     a->left = uncache();
     cache.push_back(a);
@@ -210,31 +213,31 @@ bool Parser::cond() {
     indent = startIndent;
 
     // assemble conditional
-    ExprPtr els = std::make_shared<Expression>(Expression::ELSE, "", orige);
+    ExprPtr els = ExprPtr::make(Expression::ELSE, "", orige);
     ExprPtr curr = els;
     for (uint i = elseCached; i < cache.size(); ++i) {
         curr->left = cache[i];
         if (i < cache.size() - 1) {
-            curr->right = std::make_shared<Expression>(Expression::NEXT, "", orig);
+            curr->right = ExprPtr::make(Expression::NEXT, "", orig);
             curr = curr->right;
         }
     }
     cache.resize(elseCached);
 
-    ExprPtr mn = std::make_shared<Expression>(Expression::MAIN, "", origt);
+    ExprPtr mn = ExprPtr::make(Expression::MAIN, "", origt);
     curr = mn;
     for (uint i = cached; i < cache.size(); ++i) {
         curr->left = cache[i];
         if (i < cache.size() - 1) {
-            curr->right = std::make_shared<Expression>(Expression::NEXT, "", orig);
+            curr->right = ExprPtr::make(Expression::NEXT, "", orig);
             curr = curr->right;
         }
     }
     cache.resize(cached);
 
-    ExprPtr ifer = std::make_shared<Expression>(Expression::IF, "", orig);
+    ExprPtr ifer = ExprPtr::make(Expression::IF, "", orig);
     ifer->left = uncache(); // condition
-    ExprPtr branches = std::make_shared<Expression>(Expression::BRANCHES, "", orig);
+    ExprPtr branches = ExprPtr::make(Expression::BRANCHES, "", orig);
     branches->left = mn;
     if (hasElse)
         branches->right = els;
@@ -244,6 +247,69 @@ bool Parser::cond() {
     return true;
 }
 
+bool Parser::loop() {
+    uint startIndent = indent;
+    uint orig = index;
+    bool isFor = checkLit("for");
+    if (!isFor && !checkLit("while"))
+        return false;
+
+    std::string params = "";
+    if (isFor) {
+        while (name()) {
+            params += uncache()->val + " ";
+            if (!checkLit(","))
+                break;
+        }
+        if (params == "")
+            throw Error(NO_PARAMETER);
+        params.pop_back();
+        if (!checkLit("in"))
+            throw Error(NO_IN);
+    }
+
+    // the 'do' after the header belongs to the loop, not to a call
+    noYield = true;
+    bool header = (isFor) ? call() || value() || file() : set() || call() || value();
+    noYield = false;
+    if (!header)
+        throw Error(NOT_AN_EXPRESSION);
+    if (!checkLit("do"))
+        throw Error(NO_DO);
+
+    if (checkIndent(Indent::SAME))
+        throw Error(NO_INDENT);
+
+    uint cached = cache.size();
+    if (checkIndent(Indent::MORE)) {
+        while (expr())
+            if (!checkIndent(Indent::SAME))
+                break;
+    } else if (!expr())
+        throw Error(NOT_AN_EXPRESSION);
+    indent = startIndent;
+
+    // assemble loop
+    ExprPtr mn = ExprPtr::make(Expression::MAIN, "", orig);
+    ExprPtr curr = mn;
+    for (uint i = cached; i < cache.size(); ++i) {
+        curr->left = cache[i];
+        if (i < cache.size() - 1) {
+            curr->right = ExprPtr::make(Expression::NEXT, "", orig);
+            curr = curr->right;
+        }
+    }
+    cache.resize(cached);
+
+    auto type = (isFor) ? Expression::FOR : Expression::WHILE;
+    ExprPtr lp = ExprPtr::make(type, params, orig);
+    lp->left = uncache();
+    lp->right = mn;
+    cache.push_back(lp);
+
+    return true;
+}
+
 bool Parser::oper() {
     uint cached = cache.size();
 
@@ -252,7 +318,7 @@ bool Parser::oper() {
 
     bool first = (cached < 2) || (cache[cached - 2]->type != Expression::PART_OPER);
 
-    cache.push_back(std::make_shared<Expression>(Expression::PART_OPER, get().val, index));
+    cache.push_back(ExprPtr::make(Expression::PART_OPER, get().val, index));
     ++index;
 
     if (!value() && !call())
@@ -282,7 +348,7 @@ bool Parser::oper() {
             if (priority != p)
                 continue;
 
-            ExprPtr o = std::make_shared<Expression>(Expression::OPER, (*it)->val, origp);
+            ExprPtr o = ExprPtr::make(Expression::OPER, (*it)->val, origp);
             o->left = *(it - 1);
             o->right = *(it + 1);
             cache.erase(it - 1, it + 2);
@@ -295,14 +361,14 @@ bool Parser::oper() {
 
 bool Parser::keyword() {
     if (get().val == "return") {
-        ExprPtr r = std::make_shared<Expression>(Expression::RETURN, "", index);
+        ExprPtr r = ExprPtr::make(Expression::RETURN, "", index);
         ++index;
         if (expr())
             r->right = uncache();
         cache.push_back(r);
         return true;
     } else if (get().val == "break") {
-        cache.push_back(std::make_shared<Expression>(Expression::BREAK, "", index));
+        cache.push_back(ExprPtr::make(Expression::BREAK, "", index));
         ++index;
         return true;
     }
@@ -313,7 +379,7 @@ bool Parser::file() {
     if (get().type != Token::FILEPATH)
         return false;
 
-    cache.push_back(std::make_shared<Expression>(Expression::FILE, get().val.substr(1), index));
+    cache.push_back(ExprPtr::make(Expression::FILE, get().val.substr(1), index));
     ++index;
     return true;
 }
@@ -322,7 +388,7 @@ bool Parser::name() {
     if (get().type != Token::NAME)
         return false;
 
-    cache.push_back(std::make_shared<Expression>(Expression::NAME, get().val, index));
+    cache.push_back(ExprPtr::make(Expression::NAME, get().val, index));
     ++index;
     return true;
 }
@@ -359,12 +425,12 @@ bool Parser::value() {
             if (!expr()) {
                 if (cache.size() != cached)
                     throw Error(NOTHING_TO_SET);
-                cache.push_back(std::make_shared<Expression>(Expression::EMPTY_TABL, "", origt));
+                cache.push_back(ExprPtr::make(Expression::EMPTY_TABL, "", origt));
                 empty = true;
                 break;
             }
 
-            ExprPtr tabl = std::make_shared<Expression>(Expression::TABL, nam, origt);
+            ExprPtr tabl = ExprPtr::make(Expression::TABL, nam, origt);
             tabl->left = uncache();
             cache.push_back(tabl);
 
@@ -401,7 +467,7 @@ bool Parser::string() {
         return false;
 
     std::string s = get().val.substr(1, get().val.size() - 2);
-    cache.push_back(std::make_shared<Expression>(Expression::STR, s, index));
+    cache.push_back(ExprPtr::make(Expression::STR, s, index));
     ++index;
     return true;
 }
@@ -411,7 +477,7 @@ bool Parser::fstring() {
         return false;
 
     std::string s = get().val.substr(1, get().val.size() - 2);
-    cache.push_back(std::make_shared<Expression>(Expression::FSTR, s, index));
+    cache.push_back(ExprPtr::make(Expression::FSTR, s, index));
     ++index;
     return true;
 }
@@ -424,14 +490,14 @@ bool Parser::integer() {
             if (bin[i] == '1')
                 num += std::pow(2, bin.size() - i - 1);
         }
-        cache.push_back(std::make_shared<Expression>(Expression::INT, std::to_string(num), index));
+        cache.push_back(ExprPtr::make(Expression::INT, std::to_string(num), index));
         ++index;
         return true;
     }
 
     if (get().type == Token::HEXNUM) {
         oca_int num = std::stoll(get().val, 0, 16);
-        cache.push_back(std::make_shared<Expression>(Expression::INT, std::to_string(num), index));
+        cache.push_back(ExprPtr::make(Expression::INT, std::to_string(num), index));
         ++index;
         return true;
     }
@@ -451,7 +517,7 @@ bool Parser::integer() {
     }
 
     std::string val = minus ? "-" + get().val : get().val;
-    cache.push_back(std::make_shared<Expression>(Expression::INT, val, index));
+    cache.push_back(ExprPtr::make(Expression::INT, val, index));
     ++index;
     return true;
 }
@@ -475,7 +541,7 @@ bool Parser::real() {
         std::string num = std::to_string(base * std::pow(10, power));
 
         std::string val = minus ? "-" + num : num;
-        cache.push_back(std::make_shared<Expression>(Expression::REAL, val, index));
+        cache.push_back(ExprPtr::make(Expression::REAL, val, index));
         ++index;
         return true;
     }
@@ -487,7 +553,7 @@ bool Parser::real() {
     }
 
     std::string val = minus ? "-" + get().val : get().val;
-    cache.push_back(std::make_shared<Expression>(Expression::REAL, val, index));
+    cache.push_back(ExprPtr::make(Expression::REAL, val, index));
     ++index;
     return true;
 }
@@ -496,7 +562,7 @@ bool Parser::boolean() {
     if (get().type != Token::BOOLEAN)
         return false;
 
-    cache.push_back(std::make_shared<Expression>(Expression::BOOL, get().val, index));
+    cache.push_back(ExprPtr::make(Expression::BOOL, get().val, index));
     ++index;
     return true;
 }
@@ -532,22 +598,138 @@ bool Parser::block() {
     indent = startIndent;
 
     // assemble block
-    ExprPtr bl = std::make_shared<Expression>(Expression::BLOCK, params, orig);
+    ExprPtr bl = ExprPtr::make(Expression::BLOCK, params, orig);
     ExprPtr curr = bl;
     for (uint i = cached; i < cache.size(); ++i) {
         curr->left = cache[i];
         if (i < cache.size() - 1) {
-            curr->right = std::make_shared<Expression>(Expression::NEXT, "", orig);
+            curr->right = ExprPtr::make(Expression::NEXT, "", orig);
             curr = curr->right;
         }
     }
     cache.resize(cached);
+    capture(bl);
 
     cache.push_back(bl);
 
     return true;
 }
 
+namespace {
+
+// names read and assigned by a block body, nested blocks count with their upvalues
+void collect(ExprPtr expr, std::vector<std::string>& reads, std::vector<std::string>& sets) {
+    if (!expr)
+        return;
+
+    switch (expr->type) {
+    case Expression::CALL:
+        reads.push_back(expr->val);
+        break;
+    case Expression::ACCESS:
+        // the member name is not a variable
+        collect(expr->left, reads, sets);
+        collect(expr->right->left, reads, sets);
+        collect(expr->right->right, reads, sets);
+        return;
+    case Expression::SET: {
+        ExprPtr it = expr->left;
+        while (it && it->type == Expression::CALLS) {
+            if (it->left->type == Expression::CALL)
+                sets.push_back(it->left->val);
+            else
+                collect(it->left, reads, sets);
+            it = it->right;
+        }
+        if (it && it->type == Expression::CALL)
+            sets.push_back(it->val);
+        else
+            collect(it, reads, sets);
+        collect(expr->right, reads, sets);
+        return;
+    }
+    case Expression::FOR: {
+        std::string param = "";
+        for (char c : expr->val + " ") {
+            if (c == ' ') {
+                sets.push_back(param);
+                param = "";
+            } else
+                param += c;
+        }
+        break;
+    }
+    case Expression::BLOCK:
+        for (auto& up : expr->upvalues)
+            reads.push_back(up.first);
+        return;
+    case Expression::FSTR: {
+        // code inside braces is parsed when the string is made
+        bool inner = false;
+        bool escape = false;
+        char prev = ' ';
+        std::string word = "";
+        for (char c : expr->val + " ") {
+            bool part = std::isalnum(c) || c == '_';
+            if (inner && !part && word != "") {
+                if (!std::isdigit(word[0]))
+                    reads.push_back(word);
+                word = "";
+            }
+            if (escape)
+                escape = false;
+            else if (c == '\\')
+                escape = true;
+            else if (c == '{')
+                inner = true;
+            else if (c == '}')
+                inner = false;
+            else if (inner && part && (word != "" || prev != '.'))
+                word += c;
+            if (c != ' ')
+                prev = c;
+        }
+        return;
+    }
+    default: break;
+    }
+    collect(expr->left, reads, sets);
+    collect(expr->right, reads, sets);
+}
+
+} // namespace
+
+void Parser::capture(ExprPtr block) {
+    std::vector<std::string> reads;
+    std::vector<std::string> sets;
+    collect(block->left, reads, sets);
+    collect(block->right, reads, sets);
+
+    std::vector<std::string> own = {"self", "yield", "super", "true", "false", "and", "or",
+                                    "xor", "lsh", "rsh", "do", "if", "then", "else", "while",
+                                    "for", "in", "return", "break", "with", "pub"};
+    std::string param = "";
+    for (char c : block->val + " ") {
+        if (c == ' ') {
+            own.push_back(param);
+            param = "";
+        } else
+            param += c;
+    }
+
+    for (auto& name : reads) {
+        if (std::find(own.begin(), own.end(), name) != own.end())
+            continue;
+        bool seen = false;
+        for (auto& up : block->upvalues)
+            seen = seen || up.first == name;
+        if (seen)
+            continue;
+        bool assigned = std::find(sets.begin(), sets.end(), name) != sets.end();
+        block->upvalues.push_back({name, assigned});
+    }
+}
+
 // ----------------------------
 
 bool Parser::checkLit(const std::string& t) {
@@ -21,6 +21,8 @@ public:
         CALL,
         ACCESS,
         IF,
+        WHILE,
+        FOR,
         ELSE,
         NEXT,
         MAIN,
@@ -42,11 +44,14 @@ public:
         CALLS
     };
 
+    RefCount refs{0};
     Type type;
     std::string val;
     ExprPtr left;
     ExprPtr right;
     uint index;
+    // names a block takes from outside, flagged if the block also assigns them
+    std::vector<std::pair<std::string, bool>> upvalues;
 
     Expression(Type type, const std::string& val, uint index);
     void print(uint indent = 0, char mod = '.');
@@ -57,6 +62,7 @@ class Parser {
     std::vector<ExprPtr> cache;
     uint index;
     uint indent;
+    bool noYield;
 
 public:
     Parser() = default;
@@ -71,6 +77,7 @@ private:
     bool call(bool inDot = false);
     bool access();
     bool cond();
+    bool loop();
     bool oper();
     bool keyword();
     bool file();
@@ -82,6 +89,7 @@ private:
     bool real();
     bool boolean();
     bool block();
+    void capture(ExprPtr block);
 
     bool checkLit(const std::string& t);
     bool checkIndent(Indent ind);
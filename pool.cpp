@@ -0,0 +1,326 @@
+/* ollieberzs 2018
+** pool.cpp
+** size class allocator and cycle collector for heap values
+*/
+
+#include <chrono>
+#include "box.hpp"
+
+OCA_BEGIN
+
+namespace {
+// objects made outside of any State come from the system heap
+thread_local Pool* active = nullptr;
+}
+
+void Pool::Close::operator()(Pool* pool) const {
+    // the State is gone, so whatever is left in a cycle is garbage
+    pool->closed = true;
+    pool->sweep();
+}
+
+Pool::Use::Use(Pool* pool) : previous(active) {
+    active = pool;
+}
+
+Pool::Use::~Use() {
+    active = previous;
+}
+
+// ---------------------------------
+
+Pool* Pool::open() {
+    return new Pool();
+}
+
+Pool* Pool::current() {
+    return active;
+}
+
+Pool* Pool::of(const Object* object) {
+    const char* memory = reinterpret_cast<const char*>(object) - HEADER;
+    return *reinterpret_cast<Pool* const*>(memory);
+}
+
+Pool::~Pool() {
+    for (char* chunk : chunks)
+        delete[] chunk;
+}
+
+void* Pool::allocate(size_t size) {
+    Pool* pool = active;
+    size += HEADER;
+    char* memory = static_cast<char*>((pool) ? pool->take(size) : ::operator new(size));
+    *reinterpret_cast<Pool**>(memory) = pool;
+    return memory + HEADER;
+}
+
+void Pool::deallocate(void* ptr, size_t size) {
+    char* memory = static_cast<char*>(ptr) - HEADER;
+    Pool* pool = *reinterpret_cast<Pool**>(memory);
+    if (!pool) {
+        ::operator delete(memory);
+        return;
+    }
+    pool->give(memory, size + HEADER);
+    if (pool->closed && !pool->collecting && pool->stats.live == 0)
+        delete pool;
+}
+
+// ---------------------------------
+
+void* Pool::take(size_t size) {
+    ++stats.allocations;
+    ++stats.live;
+    stats.bytes += size;
+
+    size_t index = (size - 1) / STEP;
+    if (index >= CLASSES) {
+        stats.reserved += size;
+        return ::operator new(size);
+    }
+
+    if (Slot* slot = free[index]) {
+        free[index] = slot->next;
+        return slot;
+    }
+
+    size_t slotSize = (index + 1) * STEP;
+    if (static_cast<size_t>(end[index] - cursor[index]) < slotSize) {
+        char* chunk = new char[CHUNK];
+        chunks.push_back(chunk);
+        stats.reserved += CHUNK;
+        cursor[index] = chunk;
+        end[index] = chunk + CHUNK;
+    }
+    void* slot = cursor[index];
+    cursor[index] += slotSize;
+    return slot;
+}
+
+void Pool::give(void* ptr, size_t size) {
+    ++stats.frees;
+    --stats.live;
+    stats.bytes -= size;
+
+    size_t index = (size - 1) / STEP;
+    if (index >= CLASSES) {
+        stats.reserved -= size;
+        ::operator delete(ptr);
+        return;
+    }
+
+    Slot* slot = static_cast<Slot*>(ptr);
+    slot->next = free[index];
+    free[index] = slot;
+}
+
+// ---------------------------------
+
+void Pool::suspect(Object* object) {
+    auto& suspects = generation(object);
+    suspects.push_back(object);
+    object->root = static_cast<uint>(suspects.size());
+    // a closed pool has no State left to collect it later
+    if (closed && !collecting)
+        sweep();
+}
+
+void Pool::forget(Object* object) {
+    generation(object)[object->root - 1] = nullptr;
+    object->root = 0;
+}
+
+void Pool::sweep() {
+    // freeing garbage can release more suspects, so go until none are left
+    while (!young.empty() || !old.empty())
+        collect(true);
+    if (stats.live == 0)
+        delete this;
+}
+
+size_t Pool::automatic() {
+    // old suspects wait for every few runs, or until they pile up
+    bool full = old.size() >= PRESSURE || ++runs % MAJOR == 0;
+    if (full)
+        runs = 0;
+    return collect(full);
+}
+
+bool Pool::pressing() const {
+    return young.size() >= PRESSURE || old.size() >= PRESSURE;
+}
+
+std::vector<Object*>& Pool::generation(const Object* object) {
+    return (object->age >= PROMOTE) ? old : young;
+}
+
+void Pool::gather(std::vector<Object*>& from, std::vector<Object*>& roots, size_t budget) {
+    // newest suspects first, so the positions of the others stay valid
+    while (!from.empty() && roots.size() < budget) {
+        Object* object = from.back();
+        from.pop_back();
+        if (!object)
+            continue;
+        object->root = 0;
+        roots.push_back(object);
+    }
+}
+
+size_t Pool::collect(bool full, size_t budget) {
+    auto begin = std::chrono::steady_clock::now();
+    collecting = true;
+
+    std::vector<Object*> roots;
+    gather(young, roots, budget);
+    if (full)
+        gather(old, roots, budget);
+    ++((full) ? collector.major : collector.minor);
+
+    // take away the counts the suspects and what they hold give each other,
+    // whatever still has a count is referenced from outside
+    std::vector<Object*> stack;
+    for (Object* object : roots)
+        markGray(object, stack);
+    for (Object* object : roots)
+        scan(object, stack);
+
+    // the suspects that turned out to be alive get older
+    for (Object* object : roots) {
+        if (object->color == Object::BLACK && object->age < PROMOTE) {
+            ++object->age;
+            collector.promoted += (object->age == PROMOTE);
+        }
+    }
+
+    std::vector<Object*> white;
+    for (Object* object : roots)
+        collectWhite(object, stack, white);
+
+    // give the garbage its counts back, then hold it while the cycles are cut
+    std::vector<Object*> children;
+    for (Object* object : white) {
+        children.clear();
+        object->trace(children);
+        for (Object* child : children)
+            ++child->refs;
+    }
+    std::vector<Value> held;
+    held.reserve(white.size());
+    for (Object* object : white) {
+        if (object->root)
+            forget(object);
+        held.emplace_back(object);
+    }
+    for (Object* object : white)
+        object->clear();
+    held.clear();
+
+    collector.collected += white.size();
+    collector.young = young.size();
+    collector.old = old.size();
+
+    auto pause = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - begin);
+    size_t bucket = 0;
+    while (bucket < CollectorStats::BUCKETS - 1 && (1ll << bucket) <= pause.count())
+        ++bucket;
+    ++collector.pauses[bucket];
+    collecting = false;
+    return white.size();
+}
+
+Object* Pool::interned(std::string_view name) const {
+    auto found = strings.find(name);
+    return (found != strings.end()) ? found->second : nullptr;
+}
+
+void Pool::intern(std::string_view name, Object* object) {
+    strings[name] = object;
+}
+
+void Pool::unintern(std::string_view name) {
+    strings.erase(name);
+}
+
+// ---------------------------------
+
+void Pool::markGray(Object* object, std::vector<Object*>& stack) {
+    if (object->color == Object::GRAY)
+        return;
+    object->color = Object::GRAY;
+    stack.push_back(object);
+    while (!stack.empty()) {
+        Object* next = stack.back();
+        stack.pop_back();
+        size_t from = stack.size();
+        next->trace(stack);
+        for (size_t i = from; i < stack.size();) {
+            Object* child = stack[i];
+            --child->refs;
+            if (child->color == Object::GRAY) {
+                stack[i] = stack.back();
+                stack.pop_back();
+            } else {
+                child->color = Object::GRAY;
+                ++i;
+            }
+        }
+    }
+}
+
+void Pool::scan(Object* object, std::vector<Object*>& stack) {
+    stack.push_back(object);
+    while (!stack.empty()) {
+        Object* next = stack.back();
+        stack.pop_back();
+        if (next->color != Object::GRAY)
+            continue;
+        if (next->refs > 0) {
+            scanBlack(next, stack);
+            continue;
+        }
+        next->color = Object::WHITE;
+        next->trace(stack);
+    }
+}
+
+void Pool::scanBlack(Object* object, std::vector<Object*>& stack) {
+    // runs inside scan, so it works above the entries already on the stack
+    size_t base = stack.size();
+    object->color = Object::BLACK;
+    stack.push_back(object);
+    while (stack.size() > base) {
+        Object* next = stack.back();
+        stack.pop_back();
+        size_t from = stack.size();
+        next->trace(stack);
+        for (size_t i = from; i < stack.size();) {
+            Object* child = stack[i];
+            ++child->refs;
+            if (child->color == Object::BLACK) {
+                stack[i] = stack.back();
+                stack.pop_back();
+            } else {
+                child->color = Object::BLACK;
+                ++i;
+            }
+        }
+    }
+}
+
+void Pool::collectWhite(Object* object, std::vector<Object*>& stack,
+    std::vector<Object*>& white) {
+    stack.push_back(object);
+    while (!stack.empty()) {
+        Object* next = stack.back();
+        stack.pop_back();
+        if (next->color != Object::WHITE)
+            continue;
+        next->color = Object::BLACK;
+        white.push_back(next);
+        next->trace(stack);
+    }
+}
+
+OCA_END
@@ -0,0 +1,136 @@
+/* ollieberzs 2018
+** pool.hpp
+** size class allocator and cycle collector for heap values
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include "common.hpp"
+
+OCA_BEGIN
+
+struct PoolStats {
+    size_t allocations = 0;
+    size_t frees = 0;
+    size_t live = 0;
+    // bytes handed out to live objects and bytes taken from the system
+    size_t bytes = 0;
+    size_t reserved = 0;
+};
+
+struct CollectorStats {
+    static constexpr size_t BUCKETS = 16;
+
+    // minor collections only look at young suspects, major ones at all
+    size_t minor = 0;
+    size_t major = 0;
+    size_t collected = 0;
+    size_t promoted = 0;
+    // suspects waiting in each generation
+    size_t young = 0;
+    size_t old = 0;
+    // pauses[i] counts collections that took less than 2^i microseconds
+    size_t pauses[BUCKETS] = {};
+};
+
+// every State allocates its objects from its own pool, carving fixed size
+// slots out of big chunks and keeping freed slots in one list per size.
+// a pool and the values made by it stay on one thread
+class Pool {
+public:
+    PoolStats stats;
+    CollectorStats collector;
+
+    // the pool outlives its State until the last object made by it is freed
+    struct Close {
+        void operator()(Pool* pool) const;
+    };
+
+    // objects made while a Use is alive come from its pool
+    class Use {
+        Pool* previous;
+
+    public:
+        explicit Use(Pool* pool);
+        ~Use();
+        Use(const Use&) = delete;
+        Use& operator=(const Use&) = delete;
+    };
+
+    static Pool* open();
+    static Pool* current();
+    static Pool* of(const Object* object);
+    static void* allocate(size_t size);
+    static void deallocate(void* ptr, size_t size);
+
+    // trial deletion over the suspects, taking at most budget of them per
+    // call but tracing all they reach, returns how many objects were freed.
+    // a run is not resumable, since values may change between two calls.
+    // objects that survive a few minor collections move to the old
+    // generation, which is only looked at by full collections
+    void suspect(Object* object);
+    void forget(Object* object);
+    size_t collect(bool full, size_t budget = SIZE_MAX);
+    // the collection the evaluator runs once suspects pile up, every few
+    // of these are full
+    size_t automatic();
+    bool pressing() const;
+
+    // interned strings by their bytes, they leave when they are freed
+    Object* interned(std::string_view name) const;
+    void intern(std::string_view name, Object* object);
+    void unintern(std::string_view name);
+
+private:
+    // slots grow in steps of 16 bytes, bigger objects go to the system heap
+    static constexpr size_t STEP = 16;
+    static constexpr size_t CLASSES = 16;
+    static constexpr size_t CHUNK = 16 * 1024;
+    // the pool that made an object sits in front of it
+    static constexpr size_t HEADER = alignof(std::max_align_t);
+    // suspects gathered before the evaluator collects on its own
+    static constexpr size_t PRESSURE = 4096;
+    // minor collections an object survives before it is old
+    static constexpr uint8_t PROMOTE = 3;
+    // automatic collections from one full one to the next
+    static constexpr size_t MAJOR = 8;
+
+    struct Slot {
+        Slot* next;
+    };
+
+    Slot* free[CLASSES] = {};
+    char* cursor[CLASSES] = {};
+    char* end[CLASSES] = {};
+    std::vector<char*> chunks;
+    std::vector<Object*> young;
+    std::vector<Object*> old;
+    std::unordered_map<std::string_view, Object*> strings;
+    bool closed = false;
+    // a closed pool is not deleted while a collection still walks it
+    bool collecting = false;
+    // automatic collections since the last full one
+    size_t runs = 0;
+
+    Pool() = default;
+    ~Pool();
+    void* take(size_t size);
+    void give(void* ptr, size_t size);
+
+    std::vector<Object*>& generation(const Object* object);
+    void sweep();
+    void gather(std::vector<Object*>& from, std::vector<Object*>& roots, size_t budget);
+
+    void markGray(Object* object, std::vector<Object*>& stack);
+    void scan(Object* object, std::vector<Object*>& stack);
+    void scanBlack(Object* object, std::vector<Object*>& stack);
+    void collectWhite(Object* object, std::vector<Object*>& stack, std::vector<Object*>& white);
+};
+
+typedef std::unique_ptr<Pool, Pool::Close> PoolPtr;
+
+OCA_END
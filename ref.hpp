@@ -0,0 +1,97 @@
+/* ollieberzs 2018
+** ref.hpp
+** intrusive reference counting
+*/
+
+#pragma once
+
+#include <atomic>
+#include <utility>
+#include "common.hpp"
+
+OCA_BEGIN
+
+// a State and everything it made stays on one thread unless the
+// configuration asks for atomic counts
+#ifdef OCA_ATOMIC_REFCOUNT
+typedef std::atomic<unsigned int> RefCount;
+#else
+typedef unsigned int RefCount;
+#endif
+
+// a pointer to a type with a 'refs' member, cheaper to copy than a shared_ptr
+template <class T>
+class Ref {
+    T* ptr;
+
+public:
+    Ref() : ptr(nullptr) {}
+    Ref(std::nullptr_t) : ptr(nullptr) {}
+    explicit Ref(T* ptr) : ptr(ptr) {
+        retain();
+    }
+    Ref(const Ref& other) : ptr(other.ptr) {
+        retain();
+    }
+    Ref(Ref&& other) noexcept : ptr(other.ptr) {
+        other.ptr = nullptr;
+    }
+    ~Ref() {
+        release();
+    }
+
+    Ref& operator=(const Ref& other) {
+        // read other first, releasing this may free the node holding it
+        T* next = other.ptr;
+        other.retain();
+        release();
+        ptr = next;
+        return *this;
+    }
+    Ref& operator=(Ref&& other) noexcept {
+        if (this != &other) {
+            // take other first, releasing this may free the node holding it
+            T* next = other.ptr;
+            other.ptr = nullptr;
+            release();
+            ptr = next;
+        }
+        return *this;
+    }
+
+    template <class... Args>
+    static Ref make(Args&&... args) {
+        return Ref(new T(std::forward<Args>(args)...));
+    }
+
+    T* get() const {
+        return ptr;
+    }
+    T* operator->() const {
+        return ptr;
+    }
+    T& operator*() const {
+        return *ptr;
+    }
+    explicit operator bool() const {
+        return ptr != nullptr;
+    }
+    bool operator==(const Ref& other) const {
+        return ptr == other.ptr;
+    }
+    bool operator!=(const Ref& other) const {
+        return ptr != other.ptr;
+    }
+
+private:
+    void retain() const {
+        if (ptr)
+            ++ptr->refs;
+    }
+    void release() {
+        if (ptr && --ptr->refs == 0)
+            delete ptr;
+    }
+};
+
+OCA_END
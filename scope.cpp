@@ -3,81 +3,335 @@
 ** scope to hold named stuff
 */
 
+#include <algorithm>
 #include <iostream>
 #include "oca.hpp"
 
 OCA_BEGIN
 
-Scope::Scope(Scope* parent) : parent(parent) {}
+namespace {
+// the root of the tree the scopes of this thread grow from
+thread_local Shape* tree = nullptr;
+}
+
+// once a closure captured a variable, its value lives in a shared cell
+Value Variable::get() const {
+    return (cell) ? cell.as<Cell>().value : value;
+}
+
+void Variable::put(Value val) {
+    if (cell)
+        cell.as<Cell>().value = val;
+    else
+        value = val;
+}
+
+void Variable::bind(Value val) {
+    // closures keep the cell of the previous binding
+    cell = nullptr;
+    value = val;
+}
+
+Value Variable::box() {
+    if (!cell) {
+        // loops reuse their counters, so a captured value gets its own copy
+        cell = Value::make<Cell>((value) ? value.copy() : value);
+        value = nullptr;
+    }
+    return cell;
+}
 
 // ----------------------------
 
-void Scope::set(const std::string& name, ValuePtr value, bool pub) {
-    uint index = 0;
-    for (index = 0; index < vars.size(); ++index) {
-        auto var = vars.at(index);
-        if (var.name == name)
-            break;
+Shape* Shape::root() {
+    // made again after the last scope on it is gone
+    if (!tree)
+        tree = new Shape();
+    return tree;
+}
+
+void Shape::retain(Shape* shape) {
+    ++shape->refs;
+}
+
+void Shape::release(Shape* shape) {
+    // an unused shape leaves its parent, which may be unused now too
+    while (shape && --shape->refs == 0) {
+        Shape* parent = shape->parent;
+        if (parent) {
+            auto& out = parent->transitions;
+            out.erase(std::find(out.begin(), out.end(), shape));
+        } else if (shape == tree)
+            tree = nullptr;
+        delete shape;
+        shape = parent;
+    }
+}
+
+Shape* Shape::next(const std::string& name, bool pub) {
+    size_t hash = std::hash<std::string>()(name);
+    for (Shape* shape : transitions) {
+        const Key& key = shape->keys.back();
+        if (key.hash == hash && key.publicity == pub && key.name == name)
+            return shape;
     }
 
-    auto copy = value->copy();
-    if (!copy)
-        copy = value;
-    copy->scope.parent = this;
+    Shape* shape = new Shape();
+    shape->keys = keys;
+    shape->keys.push_back({name, pub, hash});
+    shape->parent = this;
+    shape->reindex();
+    retain(this);
+    transitions.push_back(shape);
+    return shape;
+}
+
+Shape* Shape::back(uint size) {
+    Shape* shape = this;
+    while (shape->keys.size() > size)
+        shape = shape->parent;
+    return shape;
+}
 
-    if (vars.size() > index && vars[index].value)
-        vars[index] = {vars[index].publicity, name, copy};
+int Shape::find(std::string_view name) const {
+    if (index.empty()) {
+        for (uint i = 0; i < keys.size(); ++i)
+            if (keys[i].name == name)
+                return static_cast<int>(i);
+        return -1;
+    }
+
+    size_t hash = std::hash<std::string_view>()(name);
+    size_t mask = index.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        int position = index[i];
+        if (position == -1)
+            return -1;
+        const Key& key = keys[position];
+        if (key.hash == hash && key.name == name)
+            return position;
+    }
+}
+
+std::unique_ptr<Shape> Shape::unshare() const {
+    auto shape = std::make_unique<Shape>();
+    shape->keys = keys;
+    shape->reindex();
+    return shape;
+}
+
+void Shape::append(const std::string& name, bool pub) {
+    keys.push_back({name, pub, std::hash<std::string>()(name)});
+    if (keys.size() <= LINEAR_LIMIT)
+        return;
+    // keep the index at most half full
+    if (keys.size() * 2 > index.size())
+        reindex();
     else
-        vars.push_back({pub, name, copy});
+        place(static_cast<int>(keys.size() - 1));
 }
 
-bool Scope::remove(const std::string& name) {
-    for (uint i = 0; i < vars.size(); ++i) {
-        if (vars[i].name == name) {
-            vars.erase(vars.begin() + i);
-            return true;
-            break;
-        }
+void Shape::erase(uint position) {
+    keys.erase(keys.begin() + position);
+    reindex();
+}
+
+void Shape::publish(uint position, bool pub) {
+    keys[position].publicity = pub;
+}
+
+void Shape::place(int position) {
+    size_t mask = index.size() - 1;
+    size_t i = keys[position].hash & mask;
+    while (index[i] != -1)
+        i = (i + 1) & mask;
+    index[i] = position;
+}
+
+void Shape::reindex() {
+    index.clear();
+    if (keys.size() <= LINEAR_LIMIT)
+        return;
+    size_t capacity = 16;
+    while (capacity < keys.size() * 4)
+        capacity *= 2;
+    index.assign(capacity, -1);
+    for (uint i = 0; i < keys.size(); ++i)
+        place(static_cast<int>(i));
+}
+
+// ----------------------------
+
+Scope::Scope(Scope* parent) : parent(parent), shape(Shape::root()) {
+    Shape::retain(shape);
+}
+
+Scope::Scope(const Scope& other) : vars(other.vars), parent(other.parent), shape(other.shape) {
+    if (other.own) {
+        own = other.own->unshare();
+        shape = own.get();
+    } else
+        Shape::retain(shape);
+}
+
+Scope& Scope::operator=(const Scope& other) {
+    if (this != &other) {
+        vars = other.vars;
+        parent = other.parent;
+        if (other.own) {
+            auto copy = other.own->unshare();
+            if (!own)
+                Shape::release(shape);
+            own = std::move(copy);
+            shape = own.get();
+        } else
+            adopt(other.shape);
     }
-    return false;
+    return *this;
 }
 
-ValuePtr Scope::get(const std::string& name, bool super) {
-    ValuePtr val = Nil::in(this);
-    for (auto& var : vars) {
-        if (var.name == name) {
-            val = var.value;
-            if (!super && !var.publicity)
-                throw Error(NOT_PUBLIC);
-            break;
+Scope::~Scope() {
+    if (!own)
+        Shape::release(shape);
+}
+
+// ----------------------------
+
+void Scope::set(const std::string& name, Value value, bool pub) {
+    Value copy = value.copy();
+
+    int position = shape->find(name);
+    if (position != -1) {
+        Variable& var = vars[position];
+        // a placeholder left by a closure is public if its first assignment is
+        if (!var.get() && publicity(position) != pub) {
+            unshare();
+            own->publish(position, pub);
         }
+        var.put(copy);
+        return;
     }
-    return val;
+    push(name, pub, {copy, nullptr});
 }
 
-std::string Scope::get(ValuePtr value) {
-    for (auto& var : vars) {
-        if (var.value.get() == value.get())
-            return var.name;
+bool Scope::remove(const std::string& name) {
+    int position = shape->find(name);
+    if (position == -1)
+        return false;
+    // other scopes of this shape keep the key, so this one edits its own copy
+    unshare();
+    vars.erase(vars.begin() + position);
+    own->erase(position);
+    return true;
+}
+
+Value Scope::get(std::string_view name, bool super) {
+    int position = shape->find(name);
+    if (position == -1)
+        return NIL;
+    Value found = vars[position].get();
+    if (!found)
+        return NIL;
+    if (!super && !publicity(position))
+        throw Error(NOT_PUBLIC);
+    return found;
+}
+
+Variable* Scope::find(std::string_view name) {
+    for (Scope* it = this; it; it = it->parent) {
+        int position = it->shape->find(name);
+        if (position != -1)
+            return &it->vars[position];
     }
-    return "";
+    return nullptr;
 }
 
 void Scope::add(const Scope& scope) {
-    for (auto var : scope.vars) {
-        set(var.name, var.value, true);
+    for (uint i = 0; i < scope.vars.size(); ++i) {
+        Value value = scope.vars[i].get();
+        if (value)
+            set(scope.name(i), value, true);
+    }
+}
+
+const std::string& Scope::name(uint position) const {
+    return shape->keys[position].name;
+}
+
+bool Scope::publicity(uint position) const {
+    return shape->keys[position].publicity;
+}
+
+const Shape* Scope::layout() const {
+    return shape;
+}
+
+void Scope::push(const std::string& name, bool pub, Variable var) {
+    vars.push_back(std::move(var));
+    extend(name, pub);
+}
+
+void Scope::truncate(uint size) {
+    if (size >= vars.size())
+        return;
+    vars.erase(vars.begin() + size, vars.end());
+    if (own) {
+        own->keys.erase(own->keys.begin() + size, own->keys.end());
+        own->reindex();
+    } else
+        adopt(shape->back(size));
+}
+
+void Scope::clear() {
+    vars.clear();
+    adopt(Shape::root());
+}
+
+void Scope::trace(std::vector<Object*>& out) const {
+    for (auto& var : vars) {
+        for (const Value* held : {&var.value, &var.cell}) {
+            Object* object = held->object();
+            if (object && object->container)
+                out.push_back(object);
+        }
     }
 }
 
+void Scope::extend(const std::string& name, bool pub) {
+    if (shape->keys.size() >= Shape::SHARED_LIMIT)
+        unshare();
+    if (own)
+        own->append(name, pub);
+    else
+        adopt(shape->next(name, pub));
+}
+
+void Scope::adopt(Shape* next) {
+    // take the new shape first, letting go of the old one may free its parents
+    Shape::retain(next);
+    if (!own)
+        Shape::release(shape);
+    own = nullptr;
+    shape = next;
+}
+
+void Scope::unshare() {
+    if (own)
+        return;
+    own = shape->unshare();
+    Shape::release(shape);
+    shape = own.get();
+}
+
 // -----------------------------
 
 void Scope::print() {
     std::string out = "{";
-    for (auto& var : vars) {
-        if (!var.publicity)
+    for (auto& key : shape->keys) {
+        if (!key.publicity)
             out += "[";
-        out += var.name;
-        if (!var.publicity)
+        out += key.name;
+        if (!key.publicity)
             out += "]";
         out += " ";
     }
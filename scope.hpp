@@ -5,30 +5,110 @@
 
 #pragma once
 
+#include <string>
+#include <string_view>
 #include "common.hpp"
+#include "box.hpp"
 
 OCA_BEGIN
 
 struct Variable {
-    bool publicity;
-    std::string name;
-    ValuePtr value;
+    Value value;
+    Value cell;
+
+    Value get() const;
+    void put(Value val);
+    void bind(Value val);
+    Value box();
 };
 
+// the names and publicity of a scope in the order they were added. scopes
+// that add the same names in the same order share one shape from a tree of
+// transitions, so objects made by one literal only store their values.
+// every thread grows its own tree, and a shape is freed once no scope and
+// no longer shape uses it
+class Shape {
+public:
+    struct Key {
+        std::string name;
+        bool publicity;
+        size_t hash;
+    };
+
+    std::vector<Key> keys;
+    Shape* parent = nullptr;
+
+    // the empty shape every scope starts from
+    static Shape* root();
+    static void retain(Shape* shape);
+    static void release(Shape* shape);
+
+    Shape* next(const std::string& name, bool pub);
+    Shape* back(uint size);
+    int find(std::string_view name) const;
+
+    // a scope that outgrew the tree or lost a key edits its own copy
+    std::unique_ptr<Shape> unshare() const;
+    void append(const std::string& name, bool pub);
+    void erase(uint position);
+    void publish(uint position, bool pub);
+
+private:
+    // shapes up to this size are searched linearly
+    static constexpr uint LINEAR_LIMIT = 8;
+    // past this size a scope is treated as a dictionary and stops sharing
+    static constexpr uint SHARED_LIMIT = 64;
+
+    // scopes on this shape and transitions out of it
+    uint refs = 0;
+    std::vector<Shape*> transitions;
+    // open addressing over positions in keys, -1 marks an empty slot
+    std::vector<int> index;
+
+    void place(int position);
+    void reindex();
+
+    friend class Scope;
+};
+
+// vars hold the values in the order of shape->keys, go through
+// push/truncate/clear to change them so both stay in sync
 class Scope {
 public:
     std::vector<Variable> vars;
     Scope* parent;
 
     explicit Scope(Scope* parent);
+    Scope(const Scope& other);
+    Scope& operator=(const Scope& other);
+    ~Scope();
 
-    void set(const std::string& name, ValuePtr value, bool pub);
+    void set(const std::string& name, Value value, bool pub);
     bool remove(const std::string& name);
-    ValuePtr get(const std::string& name, bool super);
-    std::string get(ValuePtr value);
+    Value get(std::string_view name, bool super);
+    Variable* find(std::string_view name);
     void add(const Scope& scope);
 
+    const std::string& name(uint position) const;
+    bool publicity(uint position) const;
+    const Shape* layout() const;
+
+    void push(const std::string& name, bool pub, Variable var);
+    void truncate(uint size);
+    void clear();
+
+    // the objects the variables hold that could be part of a cycle
+    void trace(std::vector<Object*>& out) const;
+
     void print();
+
+private:
+    Shape* shape;
+    std::unique_ptr<Shape> own;
+
+    void extend(const std::string& name, bool pub);
+    void adopt(Shape* next);
+    void unshare();
 };
 
 OCA_END
@@ -48,6 +48,96 @@ TEST_CASE("Evaluation of basic types") {
     REQUIRE(table->tos() == "(2, 3, (true, false))");
 }
 
+TEST_CASE("Nan-boxed values") {
+    oca::State oca;
+
+    // scalars are immediates, ints past 48 bits move to the heap
+    REQUIRE(sizeof(oca::Value) == 8);
+    // the type tag of an object fits in the padding of its header
+    REQUIRE(sizeof(oca::Object) == 3 * sizeof(void*));
+    REQUIRE(oca.runString("5").object() == nullptr);
+    REQUIRE(oca.runString("2 ^ 50").object() != nullptr);
+    REQUIRE(oca.runString("2 ^ 50 + 2 ^ 50")->tos() == "2251799813685248");
+    REQUIRE(oca.runString("0 - 2 ^ 47")->tos() == "-140737488355328");
+    REQUIRE(oca.runString("(0.0 / 0.0)")->typestr() == "real");
+}
+
+TEST_CASE("Pool allocation") {
+    oca::State oca;
+
+    // the built-in functions and methods are made in the pool as well
+    REQUIRE(oca.allocations().live > 100);
+
+    // heap values come from the pool of their State and go back to it
+    size_t live = oca.allocations().live;
+    size_t made = oca.allocations().allocations;
+    oca.runString("s = 'longer' + ' string'\ns = 1");
+    REQUIRE(oca.allocations().allocations > made);
+    REQUIRE(oca.allocations().live == live);
+}
+
+TEST_CASE("Allocation-free integers") {
+    oca::State oca;
+
+    // integer results, loop counters, sizes, positions and native calls never allocate
+    size_t before = oca.allocations().allocations;
+    oca.runString("10.times do with i\n  max ((i + 1) * 2 - i, 500)");
+    size_t few = oca.allocations().allocations - before;
+    before = oca.allocations().allocations;
+    oca.runString("10000.times do with i\n  max ((i + 1) * 2 - i, 500)");
+    REQUIRE(oca.allocations().allocations - before == few);
+    before = oca.allocations().allocations;
+    oca.runString("s = 'hello world'\n10000.times do with i\n  s.size + (s.find 'w')");
+    REQUIRE(oca.allocations().allocations - before < 10);
+}
+
+TEST_CASE("Numeric table storage") {
+    oca::State oca;
+
+    // numbers sit in the array of a table without objects of their own
+    size_t bytes = oca.allocations().bytes;
+    oca.runString("numbers = (1 .. 100000).table");
+    REQUIRE(oca.allocations().bytes - bytes < 100000 * 10);
+    REQUIRE(oca.runString("numbers.insert (0, 'mixed')\nnumbers.at 100000")->tos() == "100000");
+}
+
+TEST_CASE("Shared copies") {
+    oca::State oca;
+
+    // assigning and passing a string shares it instead of copying the bytes
+    oca.runString("big = 'x' * 100000\nsame = do with s\n  t = s\n  t");
+    REQUIRE(oca.runString("same big").object() == oca.runString("big").object());
+}
+
+TEST_CASE("Short and interned strings") {
+    oca::State oca;
+
+    // short strings are immediates, equal longer ones share one object
+    REQUIRE(oca.runString("'abcde'").object() == nullptr);
+    REQUIRE(oca.runString("'abcde'")->tos() == "abcde");
+    oca.runString("x = 'a longer string'\ny = 'a longer' + ' string'");
+    REQUIRE(oca.runString("x").object() == oca.runString("y").object());
+    REQUIRE(oca.runString("x == y")->tos() == "true");
+    REQUIRE(oca.runString("'abc' == 'abd'")->tos() == "false");
+    // strings interned by another State compare by their bytes
+    oca::State other;
+    oca::Value z = other.runString("'a longer string'");
+    REQUIRE(oca::String::equal(oca.runString("x"), z));
+    REQUIRE(oca.runString("('a,bc,,longer one'.split ',').size")->tos() == "4");
+    REQUIRE(oca.runString("'a,b'.split ''")->tos() == "(a,b)");
+}
+
+TEST_CASE("String ropes") {
+    oca::State oca;
+
+    // long strings built piece by piece are joined once they are read
+    oca.runString("s = ''\ni = 0\nbuild = do\n  while i < 20000 do\n    s = s + 'ab'\n    i = i + 1\n    s");
+    oca.runString("s = build");
+    REQUIRE(oca.runString("s.size")->tos() == "40000");
+    REQUIRE(oca.runString("s == 'ab' * 20000")->tos() == "true");
+    REQUIRE(oca.runString("(s + 'c').find 'c'")->tos() == "40000");
+}
+
 TEST_CASE("Variable setting and getting") {
     oca::State oca;
 
@@ -151,3 +241,344 @@ TEST_CASE("Operators") {
     REQUIRE(oca.runString("true and false")->tos() == "false");
     REQUIRE(oca.runString("true or false")->tos() == "true");
 }
+
+TEST_CASE("Control flow") {
+    oca::State oca;
+
+    // return from inside a conditional
+    oca.runString("sign = do with n\n  if n < 0 then return 0 - 1\n  if n > 0 then return 1\n  0");
+    REQUIRE(oca.runString("sign (-5)")->tos() == "-1");
+    REQUIRE(oca.runString("sign 5")->tos() == "1");
+    REQUIRE(oca.runString("sign 0")->tos() == "0");
+
+    // return only leaves the innermost block
+    oca.runString("outer = do\n  inner = do\n    return 1\n  inner\n  2");
+    REQUIRE(oca.runString("outer")->tos() == "2");
+
+    // break leaves the block with the last value
+    oca.runString("stop = do\n  if true then\n    a = 3\n    break\n  4");
+    REQUIRE(oca.runString("stop")->tos() == "3");
+}
+
+TEST_CASE("Tail calls") {
+    oca::State oca;
+
+    // self recursion deeper than the native stack allows
+    oca.runString("count = do with n, acc\n  if n == 0 then return acc\n  count (n - 1, acc + 1)");
+    REQUIRE(oca.runString("count (100000, 0)")->tos() == "100000");
+
+    // mutual recursion through return
+    oca.runString("even = do with n\n  if n == 0 then return true\n  odd n - 1");
+    oca.runString("odd = do with n\n  if n == 0 then return false\n  return even n - 1");
+    REQUIRE(oca.runString("even 20001")->tos() == "false");
+}
+
+TEST_CASE("Loops") {
+    oca::State oca;
+
+    // while keeps its locals between iterations
+    REQUIRE(oca.runString("i = 0\nwhile i < 5 do i = i + 1")->tos() == "5");
+
+    // for over table values, keys and strings
+    REQUIRE(oca.runString("for v in (1, 2, 3) do v * 2")->tos() == "6");
+    REQUIRE(oca.runString("for k, v in (pub a: 1) do k + v")->tos() == "a1");
+    REQUIRE(oca.runString("for i, c in 'ab' do c + i")->tos() == "b1");
+
+    // break ends the loop and return leaves the surrounding block
+    REQUIRE(oca.runString("for v in (1, 2, 3) do\n  if v == 2 then break\n  v")->tos() == "1");
+    oca.runString("find = do\n  for v in (4, 5, 6) do\n    if v == 5 then return 'found'\n  'none'");
+    REQUIRE(oca.runString("find")->tos() == "found");
+
+    // native loops stop on break and reset locals between iterations
+    oca.runString("sum = 0\nt = ()\n5.times do with i\n  if i == 3 then break\n  t.insert (i, i)");
+    REQUIRE(oca.runString("t")->tos() == "(0, 1, 2)");
+    REQUIRE(oca.runString("(3, 1, 2).sort do with a, b\n  a < b")->tos() == "(1, 2, 3)");
+}
+
+TEST_CASE("Closures") {
+    oca::State oca;
+
+    // returned blocks keep the variables of the call that made them
+    oca.runString("adder = do with n\n  return do with x\n    x + n");
+    oca.runString("add5 = adder 5\nadd1 = adder 1");
+    REQUIRE(oca.runString("add5 10")->tos() == "15");
+    REQUIRE(oca.runString("add1 10")->tos() == "11");
+
+    // yield blocks see the locals where they were written
+    oca.runString("twice = do\n  yield 1\n  yield 2");
+    oca.runString("run = do\n  base = 10\n  twice do with n\n    base + n");
+    REQUIRE(oca.runString("run")->tos() == "12");
+
+    // local recursion and sibling members defined later
+    oca.runString("fact = do with n\n  f = do with k\n    if k < 2 then return 1\n    k * f k - 1\n  f n");
+    REQUIRE(oca.runString("fact 5")->tos() == "120");
+    oca.runString("obj = (pub get: do a + 1, pub a: 3)");
+    REQUIRE(oca.runString("obj.get")->tos() == "4");
+    oca.runString("obj.a = 5");
+    REQUIRE(oca.runString("obj.get")->tos() == "6");
+
+    // blocks copied into a child table see the members of the child
+    oca.runString("Animal = (pub speed: 1, pub run: do speed * 2)\nDog = (*: Animal)");
+    oca.runString("Dog.speed = 5");
+    REQUIRE(oca.runString("Dog.run")->tos() == "10");
+    REQUIRE(oca.runString("Animal.run")->tos() == "2");
+
+    // a yield block of a native loop keeps the self of the method it is in
+    oca.runString(
+        "rex = (pub name: 'rex', pub items: (1, 2), pub names: do\n"
+        "  seen = ()\n  items.each do with i, v\n    seen.insert (i, self.name)\n  seen)");
+    REQUIRE(oca.runString("rex.names")->tos() == "(rex, rex)");
+}
+
+TEST_CASE("Ranges") {
+    oca::State oca;
+
+    // ranges are lazy and never build their elements
+    oca.runString("r = 1 .. 10000000");
+    REQUIRE(oca.runString("r")->typestr() == "range");
+    REQUIRE(oca.runString("r.size")->tos() == "10000000");
+    REQUIRE(oca.runString("r.at 9999999")->tos() == "10000000");
+    REQUIRE(oca.runString("(5 .. 4).size")->tos() == "0");
+
+    // splitting, looping and materializing
+    REQUIRE(oca.runString("a, b = 4 .. 5\na * b")->tos() == "20");
+    REQUIRE(oca.runString("add = do with x, y\n  x + y\nadd 3 .. 4")->tos() == "7");
+    REQUIRE(oca.runString("for i, v in 3 .. 5 do i * v")->tos() == "10");
+    REQUIRE(oca.runString("(2 .. 4).table")->typestr() == "(int, int, int)");
+}
+
+TEST_CASE("Table array part") {
+    oca::State oca;
+
+    // indexed elements keep their order next to named members
+    oca.runString("t = (1, 2, pub name: 'x', 3)");
+    REQUIRE(oca.runString("t")->tos() == "(1, 2, 3, name: x)");
+    REQUIRE(oca.runString("t.size")->tos() == "4");
+    REQUIRE(oca.runString("t.at 2")->tos() == "3");
+    REQUIRE(oca.runString("t.at 'name'")->tos() == "x");
+    oca.runString("u = (5, 6)\nu.insert ('01', 'named')");
+    REQUIRE(oca.runString("u.at '01'")->tos() == "named");
+    REQUIRE(oca.runString("u.at 1")->tos() == "6");
+
+    // inserting and removing shift the indexed elements
+    REQUIRE(oca.runString("t.insert (1, true)")->tos() == "(1, true, 2, 3, name: x)");
+    REQUIRE(oca.runString("t.remove 0")->tos() == "(true, 2, 3, name: x)");
+    REQUIRE(oca.runString("t.insert (3, 4)\nt.at 3")->tos() == "4");
+    REQUIRE(oca.runString("t.remove 'name'")->tos() == "(true, 2, 3, 4)");
+    oca.runString("keys = ()\nt.each do with i, v\n  keys.insert (i, i)");
+    REQUIRE(oca.runString("keys")->tos() == "(0, 1, 2, 3)");
+
+    // large tables index in constant time
+    oca.runString("big = (0 .. 99999).table");
+    REQUIRE(oca.runString("big.at 99999")->tos() == "99999");
+    REQUIRE(oca.runString("big.size")->tos() == "100000");
+}
+
+TEST_CASE("Scope hash index") {
+    oca::State oca;
+
+    // members past the linear limit are found through the hash index
+    oca.runString(
+        "wide = (pub a: 1, pub b: 2, pub c: 3, pub d: 4, pub e: 5, pub f: 6,\n"
+        "pub g: 7, pub h: 8, pub i: 9, pub j: 10, pub k: 11, pub l: 12)");
+    REQUIRE(oca.runString("wide.a + wide.l")->tos() == "13");
+    oca.runString("wide.remove 'c'\nwide.h = 80");
+    REQUIRE(oca.runString("wide.at 'c'")->tos() == "nil");
+    REQUIRE(oca.runString("wide.h + wide.k")->tos() == "91");
+}
+
+TEST_CASE("Table shapes") {
+    oca::State oca;
+
+    // tables made by the same literal share one shape
+    oca.runString("point = do with x, y\n  (pub x: x, pub y: y)");
+    auto first = oca.runString("point (1, 2)");
+    auto second = oca.runString("point (3, 4)");
+    REQUIRE(first.as<oca::Table>().scope.layout() == second.as<oca::Table>().scope.layout());
+
+    // removing a member moves only that table off the shared shape
+    first.as<oca::Table>().scope.remove("x");
+    auto third = oca.runString("point (5, 6)");
+    REQUIRE(first.as<oca::Table>().scope.layout() != second.as<oca::Table>().scope.layout());
+    REQUIRE(second.as<oca::Table>().scope.layout() == third.as<oca::Table>().scope.layout());
+    REQUIRE(first.as<oca::Table>().scope.layout()->keys.size() == 1);
+}
+
+TEST_CASE("Table clone and freeze") {
+    oca::State oca;
+
+    // clones share elements until one side changes them
+    oca.runString("t = (true, 2, 3, 4)");
+    oca.runString("c = t.clone\nc.insert (0, 'c')\nt.insert (4, 't')");
+    REQUIRE(oca.runString("c")->tos() == "(c, true, 2, 3, 4)");
+    REQUIRE(oca.runString("t")->tos() == "(true, 2, 3, 4, t)");
+    oca.runString("big = (0 .. 99999).table\ncopy = big.clone\ncopy.remove 0");
+    REQUIRE(oca.runString("(big.at 50000) - (copy.at 50000)")->tos() == "-1");
+
+    // a frozen table ignores changes, its clone does not
+    oca.runString("t.freeze\nt.insert (0, 1)");
+    REQUIRE(oca.runString("t.frozen")->tos() == "true");
+    REQUIRE(oca.runString("t.size")->tos() == "5");
+    REQUIRE(oca.runString("t.clone.frozen")->tos() == "false");
+
+    // methods of a clone work on its own members
+    oca.runString("p = (pub x: 1, pub get: do x)\nq = p.clone\nq.x = 5");
+    REQUIRE(oca.runString("q.get")->tos() == "5");
+    REQUIRE(oca.runString("p.get")->tos() == "1");
+}
+
+TEST_CASE("Numeric table kernels") {
+    oca::State oca;
+
+    // numeric tables fold and combine without running a block per element
+    oca.runString("big = (0 .. 99999).table");
+    REQUIRE(oca.runString("big.sum")->tos() == "4999950000");
+    REQUIRE(oca.runString("big.min + big.max")->tos() == "99999");
+    REQUIRE(oca.runString("(1, 2, 3, 4).mean")->tos() == "2.5");
+    REQUIRE(oca.runString("(1, 2.5, 3).sum")->tos() == "6.5");
+    REQUIRE(oca.runString("(1, 2, 3).dot (4, 5, 6)")->tos() == "32");
+    REQUIRE(oca.runString("(1, 2, 3) * 2 + (0.5, 0.5, 0.5)")->tos() == "(2.5, 4.5, 6.5)");
+    REQUIRE(oca.runString("(10, 20) / 5 - 1")->tos() == "(1, 3)");
+    REQUIRE(oca.runString("().sum")->tos() == "0");
+    REQUIRE(oca.runString("(1, 'a').sum")->isNil());
+}
+
+TEST_CASE("Cycle collection") {
+    oca::State oca;
+
+    // two tables pointing at each other outlive their names until collected
+    size_t live = oca.allocations().live;
+    oca.runString("a = (pub other: 0)\nb = (pub other: a)\na.other = b\na = 0\nb = 0");
+    REQUIRE(oca.allocations().live > live);
+    REQUIRE(oca.collect() == 2);
+    REQUIRE(oca.allocations().live == live);
+
+    // a local block calling itself holds its own cell
+    oca.runString("make = do\n  f = do with n\n    if n == 0 then return 0\n    f n - 1\n  f 3");
+    live = oca.allocations().live;
+    REQUIRE(oca.runString("make")->tos() == "0");
+    size_t freed = 0;
+    for (int i = 0; i < 1000 && freed == 0; ++i)
+        freed = oca.step(1);
+    REQUIRE(freed > 0);
+    oca.collect();
+    REQUIRE(oca.allocations().live == live);
+
+    // reachable cycles stay
+    oca.runString("c = (pub other: 0)\nc.other = c");
+    oca.collect();
+    REQUIRE(oca.runString("c.other.other").object() == oca.runString("c").object());
+
+    // suspects that keep surviving move to the old generation
+    size_t promoted = oca.collector().promoted;
+    for (int i = 0; i < 3; ++i) {
+        oca.runString("x = c\nx = 0");
+        oca.step(16);
+    }
+    REQUIRE(oca.collector().promoted == promoted + 1);
+    size_t pauses = 0;
+    for (size_t count : oca.collector().pauses)
+        pauses += count;
+    REQUIRE(pauses == oca.collector().minor + oca.collector().major);
+
+    // steps stay minor, only every few automatic collections are full
+    size_t minor = oca.collector().minor;
+    size_t major = oca.collector().major;
+    for (int i = 0; i < 80; ++i)
+        oca.step(16);
+    REQUIRE(oca.collector().minor - minor == 80);
+    REQUIRE(oca.collector().major == major);
+    oca.runString("40000.times do\n  r = (pub other: 0)\n  r.other = r");
+    size_t runs = oca.collector().minor - minor - 80 + oca.collector().major - major;
+    REQUIRE(runs >= 8);
+    REQUIRE(oca.collector().major - major == runs / 8);
+
+    // a cycle dropped after its State is gone is freed with the pool
+    oca::Value kept;
+    {
+        oca::State closed;
+        kept = closed.runString("a = (pub other: 0)\nb = (pub other: a)\na.other = b\na");
+    }
+    REQUIRE(kept.as<oca::Table>().scope.get("other", false).is<oca::Table>());
+    kept = oca::Value();
+}
+
+TEST_CASE("Native argument passing") {
+    oca::State oca;
+
+    // native functions check their arguments however they are passed
+    REQUIRE(oca.runString("max (3.5, 4.5)")->tos() == "4.5");
+    REQUIRE(oca.runString("pair = (3, 7)\nmin pair")->tos() == "3");
+    REQUIRE(oca.runString("x = 2\nlog (2.0, x ^ 3 * 1.0)")->tos() == "3.0");
+    REQUIRE(oca.runString("max (3, 'a')")->isNil());
+}
+
+TEST_CASE("Binding native functions") {
+    oca::State oca;
+
+    // parameter types and the result are taken from the c++ function
+    oca.bind("scale", [](oca_int times, std::string_view text) -> oca_real {
+        return static_cast<oca_real>(times) * static_cast<oca_real>(text.size());
+    });
+    REQUIRE(oca.runString("scale (3, 'four')")->tos() == "12.0");
+    REQUIRE(oca.runString("scale (3, 4)")->isNil());
+
+    oca.bind("shout", [](std::string text) { return text + "!"; });
+    REQUIRE(oca.runString("shout 'hey'")->tos() == "hey!");
+
+    oca.bind("half", [](double value) { return value / 2; });
+    REQUIRE(oca.runString("half 5")->tos() == "2.5");
+
+    int calls = 0;
+    oca.bind("count", [&calls](oca::Value) { ++calls; });
+    REQUIRE(oca.runString("count (1, 2)\ncount 3")->isNil());
+    REQUIRE(calls == 2);
+
+    // functions bound by their params string still get the argument table
+    oca.bind("pair", "ii", [&] CPPFUNC {
+        return oca::cast(arg.value->item(0)->toi() * 10 + arg.value->item(1)->toi());
+    });
+    REQUIRE(oca.runString("pair (4, 2)")->tos() == "42");
+}
+
+TEST_CASE("Early return benchmark", "[.][benchmark]") {
+    oca::State oca;
+
+    oca.runString(
+        "classify = do with n\n"
+        "  if n % 2 == 0 then return 'even'\n"
+        "  if n % 3 == 0 then return 'odd three'\n"
+        "  if n % 5 == 0 then return 'odd five'\n"
+        "  'odd'");
+
+    BENCHMARK("1000 calls returning early") {
+        oca.runString("1000.times do with i\n  classify i");
+    }
+}
+
+TEST_CASE("Integer arithmetic benchmark", "[.][benchmark]") {
+    oca::State oca;
+
+    const char* loop = "10000.times do with i\n  (i * 3 + 7) % 1000 + 'abc'.size";
+    size_t before = oca.allocations().allocations;
+    oca.runString(loop);
+    WARN("heap allocations for 10000 iterations: " << oca.allocations().allocations - before);
+
+    BENCHMARK("10000 iterations of integer arithmetic") {
+        oca.runString(loop);
+    }
+}
+
+TEST_CASE("Numeric table benchmark", "[.][benchmark]") {
+    oca::State oca;
+
+    oca.runString("numbers = (1 .. 1000000).table");
+
+    BENCHMARK("sum of a million numbers") {
+        oca.runString("numbers.sum");
+    }
+
+    BENCHMARK("scaling a million numbers") {
+        oca.runString("numbers * 2");
+    }
+}
@@ -9,7 +9,10 @@
 #include <windows.h>
 #endif
 
-#include <any>
+#include <iterator>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
 #include <iostream>
 #include "common.hpp"
 #include "value.hpp"
@@ -28,30 +31,98 @@ inline void enableANSI() {
     #endif
 }
 
-inline ValuePtr cast(std::any val) {
-    if (val.type() == typeid(oca_int)) {
-        return std::make_shared<Integer>(std::any_cast<oca_int>(val), nullptr);
-    } else if (val.type() == typeid(oca_real)) {
-        return std::make_shared<Real>(std::any_cast<oca_real>(val), nullptr);
-    } else if (val.type() == typeid(bool)) {
-        return std::make_shared<Bool>(std::any_cast<bool>(val), nullptr);
-    } else if (val.type() == typeid(std::string)) {
-        return std::make_shared<String>(std::any_cast<std::string>(val), nullptr);
-    } else if (val.type() == typeid(std::vector<oca_int>)) {
-        auto vec = std::any_cast<std::vector<oca_int>>(val);
-        auto table = std::make_shared<Table>(nullptr);
-        for (uint i = 0; i < vec.size(); ++i) {
-            ++static_cast<Table&>(*table).count;
-            ++static_cast<Table&>(*table).size;
-            table->scope.set(
-                std::to_string(i + ARRAY_BEGIN_INDEX),
-                std::make_shared<Integer>(vec[i], &table->scope), true);
-        }
-        return table;
+template <class T, class = void>
+struct Iterable : std::false_type {};
+
+template <class T>
+struct Iterable<T, std::void_t<decltype(std::begin(std::declval<T&>())),
+                               decltype(std::end(std::declval<T&>()))>> : std::true_type {};
+
+template <class>
+inline constexpr bool NOT_CASTABLE = false;
+
+// turns what a native function returns into a value, the kind of value is
+// picked from the c++ type when compiling. strings passed by rvalue move
+// their bytes into the value, containers become tables
+template <class T>
+inline Value cast(T&& val) {
+    using Type = std::decay_t<T>;
+    if constexpr (std::is_same_v<Type, Value>) {
+        return std::forward<T>(val);
+    } else if constexpr (std::is_same_v<Type, bool>) {
+        return Value::boolean(val);
+    } else if constexpr (std::is_integral_v<Type>) {
+        return Value::integer(static_cast<oca_int>(val));
+    } else if constexpr (std::is_floating_point_v<Type>) {
+        return Value::real(static_cast<oca_real>(val));
+    } else if constexpr (std::is_same_v<Type, std::string>) {
+        return Value::string(std::forward<T>(val));
+    } else if constexpr (std::is_convertible_v<const Type&, std::string_view>) {
+        return Value::string(std::string_view(val));
+    } else if constexpr (Iterable<Type>::value) {
+        Value result = Value::make<Table>();
+        auto& table = result.as<Table>();
+        for (auto&& item : val)
+            table.push(cast(item));
+        return result;
     } else {
-        std::cout << "Error: Bad cast.\n";
-        return Nil::in(nullptr);
+        static_assert(NOT_CASTABLE<Type>, "no oca value for this type");
     }
 }
 
+// the parameters and result of a function, lambda or function object
+template <class F>
+struct Signature : Signature<decltype(&F::operator())> {};
+
+template <class R, class... A>
+struct Signature<R (*)(A...)> {
+    using Result = R;
+    using Params = std::tuple<std::decay_t<A>...>;
+};
+
+template <class C, class R, class... A>
+struct Signature<R (C::*)(A...)> : Signature<R (*)(A...)> {};
+
+template <class C, class R, class... A>
+struct Signature<R (C::*)(A...) const> : Signature<R (*)(A...)> {};
+
+// the letter Func checks a c++ parameter type with, ints are also taken
+// where a real is expected
+template <class T>
+inline constexpr char param() {
+    if constexpr (std::is_same_v<T, Value>)
+        return 'a';
+    else if constexpr (std::is_same_v<T, bool>)
+        return 'b';
+    else if constexpr (std::is_integral_v<T>)
+        return 'i';
+    else if constexpr (std::is_floating_point_v<T>)
+        return 'n';
+    else if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>)
+        return 's';
+    else
+        static_assert(NOT_CASTABLE<T>, "no oca value for this parameter type");
+}
+
+template <class... A>
+inline std::string params(std::tuple<A...>*) {
+    return std::string{param<A>()...};
+}
+
+// a checked argument as the c++ type a parameter wants, string views
+// stay valid until the function returns
+template <class T>
+inline T unpack(const Value& value) {
+    if constexpr (std::is_same_v<T, Value>)
+        return value;
+    else if constexpr (std::is_same_v<T, bool>)
+        return value.tob();
+    else if constexpr (std::is_integral_v<T>)
+        return static_cast<T>(value.toi());
+    else if constexpr (std::is_floating_point_v<T>)
+        return static_cast<T>(value.isr() ? value.tor() : static_cast<oca_real>(value.toi()));
+    else
+        return T(value.view());
+}
+
 OCA_END
@@ -15,77 +15,1013 @@
 
 OCA_BEGIN
 
-bool Value::isNil() {
-    return false;
+Value Value::integer(oca_int val) {
+    if (val < INT_MIN48 || val > INT_MAX48)
+        return Value::make<Integer>(val);
+    return Value(boxed(INT, static_cast<uint64_t>(val)), 0);
 }
 
-void Value::bind(const std::string& name, const std::string& args, CPPFunc func) {
-    scope.set(name, std::make_shared<Func>(func, args, &scope), true);
+Value Value::string(std::string_view val) {
+    if (val.size() <= SHORT_STR) {
+        uint64_t payload = static_cast<uint64_t>(val.size()) << 40;
+        for (size_t i = 0; i < val.size(); ++i)
+            payload |= static_cast<uint64_t>(static_cast<unsigned char>(val[i])) << (i * 8);
+        return Value(boxed(STR, payload), 0);
+    }
+
+    // equal strings made by one State share one object
+    Pool* pool = Pool::current();
+    if (!pool || val.size() > INTERNED_STR)
+        return Value::make<String>(std::string(val));
+    if (Object* found = pool->interned(val))
+        return Value(found);
+    Value result = Value::make<String>(std::string(val));
+    String& str = result.as<String>();
+    str.interned = true;
+    pool->intern(str.text(), &str);
+    return result;
+}
+
+Value Value::string(std::string&& val) {
+    // long strings take over the bytes, the rest are copied anyway
+    if (val.size() <= INTERNED_STR)
+        return string(std::string_view(val));
+    return Value::make<String>(std::move(val));
+}
+
+oca_int Value::toi() const {
+    if ((bits & ~PAYLOAD) == boxed(INT, 0))
+        return static_cast<oca_int>(bits << 16) >> 16;
+    if (is<Integer>())
+        return as<Integer>().val;
+    return 0;
+}
+
+std::string Value::tos() const {
+    switch (tag()) {
+    case NONE: return "nil";
+    case BOOL: return (tob()) ? "true" : "false";
+    case INT: return std::to_string(toi());
+    case REAL: {
+        std::stringstream ss;
+        ss << std::setprecision(16) << std::fixed << tor();
+        std::string str = ss.str();
+        str.erase(str.find_last_not_of('0') + 1, std::string::npos);
+        if (str.back() == '.')
+            str += '0';
+        return str;
+    }
+    case OBJECT: return object()->tos();
+    case STR: return std::string(view());
+    default: return "";
+    }
+}
+
+std::string_view Value::view() const {
+    // the bytes of a short string are the low bytes of a little endian value
+    if ((bits & ~PAYLOAD) == boxed(STR, 0))
+        return std::string_view(reinterpret_cast<const char*>(&bits), (bits >> 40) & 0x7);
+    if (is<String>())
+        return as<String>().text();
+    return std::string_view();
+}
+
+std::string Value::typestr() const {
+    switch (tag()) {
+    case NONE: return "nil";
+    case BOOL: return "bool";
+    case INT: return "int";
+    case REAL: return "real";
+    case STR: return "str";
+    case OBJECT: return object()->typestr();
+    default: return "";
+    }
+}
+
+oca_int Value::length() const {
+    Object* obj = object();
+    return (obj) ? obj->length() : 0;
+}
+
+Value Value::item(oca_int index) const {
+    Object* obj = object();
+    return (obj) ? obj->item(index) : NIL;
+}
+
+// ---------------------------------
+
+Value Object::copy() {
+    return Value(this);
+}
+
+oca_int Object::length() {
+    return 0;
+}
+
+Value Object::item(oca_int) {
+    return NIL;
+}
+
+void Object::trace(std::vector<Object*>&) {}
+
+void Object::clear() {}
+
+void Object::suspect() {
+    if (root)
+        return;
+    if (Pool* pool = Pool::of(this))
+        pool->suspect(this);
+}
+
+void Object::forget() {
+    Pool::of(this)->forget(this);
+}
+
+// ---------------------------------
+
+Integer::Integer(oca_int val) : Object(KIND), val(val) {}
+
+std::string Integer::tos() {
+    return std::to_string(val);
+}
+
+std::string Integer::typestr() {
+    return "int";
+}
+
+// ---------------------------------
+
+String::String(std::string val) : Object(KIND), val(std::move(val)), size(this->val.size()) {}
+
+String::String(Value prefix, std::string_view suffix)
+    : Object(KIND), val(suffix), prefix(prefix), size(length(prefix) + suffix.size()) {}
+
+String::~String() {
+    unlink(std::move(prefix));
+    if (interned)
+        Pool::of(this)->unintern(val);
+}
+
+Value String::concat(const Value& left, std::string_view right) {
+    if (length(left) + right.size() < ROPE) {
+        std::string joined(left.view());
+        joined += right;
+        return Value::string(joined);
+    }
+    return Value::make<String>(left, right);
+}
+
+size_t String::length(const Value& value) {
+    return (value.is<String>()) ? value.as<String>().size : value.view().size();
+}
+
+bool String::equal(const Value& left, const Value& right) {
+    if (left == right)
+        return true;
+    // short strings, or strings interned in the same pool, are equal only if their bits are
+    Object* a = left.object();
+    Object* b = right.object();
+    if (!a && !b)
+        return false;
+    if (a && b) {
+        String& x = left.as<String>();
+        String& y = right.as<String>();
+        bool same = x.interned && y.interned && Pool::of(a) == Pool::of(b);
+        if (same || x.size != y.size || x.hash() != y.hash())
+            return false;
+    }
+    return left.view() == right.view();
+}
+
+const std::string& String::text() {
+    if (prefix)
+        flatten();
+    return val;
+}
+
+size_t String::hash() {
+    if (!hashed)
+        hashed = std::hash<std::string>()(text()) | 1;
+    return hashed;
+}
+
+std::string String::tos() {
+    return text();
+}
+
+std::string String::typestr() {
+    return "str";
+}
+
+void String::flatten() {
+    // walk back to the first flat piece, then copy every piece once
+    std::vector<String*> chain{this};
+    Value head = prefix;
+    while (head.is<String>() && head.as<String>().prefix) {
+        chain.push_back(&head.as<String>());
+        head = head.as<String>().prefix;
+    }
+
+    std::string result;
+    result.reserve(size);
+    result += head.view();
+    for (auto it = chain.rbegin(); it != chain.rend(); ++it)
+        result += (*it)->val;
+    val = std::move(result);
+    head = nullptr;
+    unlink(std::move(prefix));
+}
+
+void String::unlink(Value chain) {
+    // frees a long chain of pieces one by one instead of recursing
+    while (chain.is<String>() && chain.as<String>().refs == 1) {
+        Value next = std::move(chain.as<String>().prefix);
+        chain = std::move(next);
+    }
+}
+
+// ---------------------------------
+
+size_t Numbers::size() const {
+    return (real) ? reals.size() : ints.size();
+}
+
+void Numbers::widen() {
+    if (real)
+        return;
+    reals.reserve(ints.capacity());
+    reals.assign(ints.begin(), ints.end());
+    ints.clear();
+    real = true;
+}
+
+// ---------------------------------
+
+Chunk::Chunk() : Object(KIND) {
+    container = true;
+}
+
+Chunk::Chunk(const Chunk& other)
+    : Object(other), count(other.count), containers(other.containers) {
+    container = true;
+    for (uint i = 0; i < count; ++i)
+        items[i] = other.items[i];
+}
+
+void Chunk::put(uint index, Value value) {
+    Object* old = items[index].object();
+    Object* now = value.object();
+    containers -= (old && old->container);
+    containers += (now && now->container);
+    items[index] = std::move(value);
 }
 
-oca_int Value::toi() {
-    if (TYPE_EQ(*this, Integer))
-        return static_cast<Integer&>(*this).val;
+std::string Chunk::tos() {
+    return "chunk";
+}
+
+std::string Chunk::typestr() {
+    return "chunk";
+}
+
+void Chunk::trace(std::vector<Object*>& out) {
+    if (containers == 0)
+        return;
+    for (uint i = 0; i < count; ++i) {
+        Object* object = items[i].object();
+        if (object && object->container)
+            out.push_back(object);
+    }
+}
+
+void Chunk::clear() {
+    for (uint i = 0; i < count; ++i)
+        items[i] = nullptr;
+    count = 0;
+    containers = 0;
+}
+
+// ---------------------------------
+
+Table::Table(Scope* parent) : Object(KIND), scope(parent) {
+    container = true;
+}
+
+Value Table::from(Scope& scope) {
+    Value t = Value::make<Table>();
+    for (uint i = 0; i < scope.vars.size(); ++i)
+        if (scope.vars[i].get())
+            t.as<Table>().scope.push(scope.name(i), scope.publicity(i), scope.vars[i]);
+    return t;
+}
+
+Value Table::from(const Numbers& numbers) {
+    Value t = Value::make<Table>();
+    Table& table = t.as<Table>();
+    table.chunks.reserve(numbers.size() / Chunk::SIZE + 1);
+    if (numbers.real)
+        for (oca_real value : numbers.reals)
+            table.append(Value::real(value));
     else
-        return 0;
+        for (oca_int value : numbers.ints)
+            table.append(Value::integer(value));
+    return t;
+}
+
+bool Table::index(std::string_view key, oca_int& index) {
+    // "01" and the like stay named members
+    if (key.empty() || key.size() > 18 || (key.size() > 1 && key[0] == '0'))
+        return false;
+    oca_int number = 0;
+    for (char c : key) {
+        if (!std::isdigit(c))
+            return false;
+        number = number * 10 + (c - '0');
+    }
+    index = number - ARRAY_BEGIN_INDEX;
+    return index >= 0;
+}
+
+Value Table::get(std::string_view key, bool super) {
+    oca_int i = 0;
+    if (index(key, i) && i < length())
+        return item(i);
+    return scope.get(key, super);
+}
+
+void Table::set(const std::string& key, Value value, bool pub) {
+    check();
+    oca_int i = 0;
+    if (index(key, i) && i <= length()) {
+        if (i < length())
+            put(i, value.copy());
+        else
+            push(value);
+        return;
+    }
+    scope.set(key, value, pub);
+}
+
+void Table::add(const std::string& name, Value value) {
+    set(name, value, true);
+}
+
+void Table::push(Value value) {
+    check();
+    append(value.copy());
+
+    // keys set past the end before move over once the array reaches them
+    oca_int next = length() + ARRAY_BEGIN_INDEX;
+    while (!scope.vars.empty()) {
+        std::string key = std::to_string(next);
+        Value moved = scope.get(key, true);
+        if (moved.isNil())
+            break;
+        scope.remove(key);
+        append(moved);
+        ++next;
+    }
+}
+
+void Table::insert(oca_int index, Value value) {
+    check();
+    append(value.copy());
+    for (oca_int i = length() - 1; i > index; --i)
+        put(i, item(i - 1));
+    put(index, value.copy());
+}
+
+bool Table::remove(const std::string& key) {
+    check();
+    oca_int i = 0;
+    if (index(key, i) && i < length()) {
+        for (; i + 1 < length(); ++i)
+            put(i, item(i + 1));
+        pop();
+        return true;
+    }
+    return scope.remove(key);
+}
+
+void Table::sort(const std::function<bool(const Value&, const Value&)>& less) {
+    check();
+    std::vector<Value> values;
+    values.reserve(length());
+    for (oca_int i = 0; i < length(); ++i)
+        values.push_back(item(i));
+    std::sort(values.begin(), values.end(), less);
+    for (oca_int i = 0; i < length(); ++i)
+        put(i, values[i]);
+}
+
+Value Table::clone() {
+    Value result = Value::make<Table>();
+    Table& copy = result.as<Table>();
+    copy.chunks = chunks;
+    copy.count = count;
+    // members get their own variables, and methods are moved over to them
+    for (uint i = 0; i < scope.vars.size(); ++i)
+        copy.scope.push(scope.name(i), scope.publicity(i), {scope.vars[i].get(), nullptr});
+    copy.rebind(scope);
+    return result;
+}
+
+void Table::rebind(const Scope& from) {
+    // methods copied from another table work on the members of this one
+    for (auto& var : scope.vars) {
+        Value value = var.get();
+        if (value.is<Block>())
+            var.put(Block::rebind(value, from, scope));
+    }
+}
+
+void Table::numbers(Numbers& out) {
+    out.ints.clear();
+    out.reals.clear();
+    out.real = false;
+    out.ints.reserve(count);
+    for (auto& chunk : chunks) {
+        Chunk& part = chunk.as<Chunk>();
+        for (uint i = 0; i < part.count; ++i) {
+            const Value& value = part.items[i];
+            if (value.isi()) {
+                if (out.real)
+                    out.reals.push_back(static_cast<oca_real>(value.toi()));
+                else
+                    out.ints.push_back(value.toi());
+            } else if (value.isr()) {
+                out.widen();
+                out.reals.push_back(value.tor());
+            } else
+                throw Error(TYPE_MISMATCH, value.typestr() + " in table wanted int/real.");
+        }
+    }
+}
+
+void Table::freeze() {
+    frozen = true;
+}
+
+bool Table::isFrozen() const {
+    return frozen;
+}
+
+oca_int Table::length() {
+    return count;
+}
+
+oca_int Table::size() {
+    oca_int result = length();
+    for (auto& var : scope.vars)
+        if (var.get() && !var.get().is<Func>())
+            ++result;
+    return result;
+}
+
+Value Table::item(oca_int index) {
+    if (index < 0 || index >= length())
+        return NIL;
+    return chunks[index / Chunk::SIZE].as<Chunk>().items[index % Chunk::SIZE];
+}
+
+std::string Table::tos() {
+    std::string result = "(";
+    for (oca_int i = 0; i < length(); ++i) {
+        result += item(i)->tos();
+        result += ", ";
+    }
+    for (uint i = 0; i < scope.vars.size(); ++i) {
+        Value value = scope.vars[i].get();
+        if (!value || value.is<Func>())
+            continue;
+        result += scope.name(i) + ": ";
+        result += value->tos();
+        result += ", ";
+    }
+    if (result.size() > 1) {
+        result.pop_back();
+        result.pop_back();
+    }
+    result += ")";
+    return result;
+}
+
+std::string Table::typestr() {
+    std::string result = "(";
+    for (oca_int i = 0; i < length(); ++i) {
+        result += item(i)->typestr();
+        result += ", ";
+    }
+    for (auto& var : scope.vars) {
+        Value value = var.get();
+        if (!value || value.is<Func>())
+            continue;
+        result += value->typestr();
+        result += ", ";
+    }
+    if (result.size() > 1) {
+        result.pop_back();
+        result.pop_back();
+    }
+    result += ")";
+    return result;
+}
+
+void Table::trace(std::vector<Object*>& out) {
+    for (auto& chunk : chunks)
+        out.push_back(chunk.object());
+    scope.trace(out);
+}
+
+void Table::clear() {
+    chunks.clear();
+    count = 0;
+    scope.clear();
+}
+
+void Table::put(oca_int index, Value value) {
+    // a chunk another clone still sees is copied before it changes
+    Value& chunk = chunks[index / Chunk::SIZE];
+    if (chunk.as<Chunk>().refs > 1)
+        chunk = Value::make<Chunk>(chunk.as<Chunk>());
+    chunk.as<Chunk>().put(index % Chunk::SIZE, std::move(value));
+}
+
+void Table::append(Value value) {
+    if (count % Chunk::SIZE == 0)
+        chunks.push_back(Value::make<Chunk>());
+    put(count++, std::move(value));
+    ++chunks.back().as<Chunk>().count;
+}
+
+void Table::pop() {
+    put(--count, nullptr);
+    Chunk& chunk = chunks.back().as<Chunk>();
+    if (--chunk.count == 0)
+        chunks.pop_back();
+}
+
+void Table::check() const {
+    if (frozen)
+        throw Error(FROZEN_TABLE);
+}
+
+// ---------------------------------
+
+Range::Range(oca_int begin, oca_int end) : Object(KIND), begin(begin), end(end) {}
+
+Value Range::table() {
+    Value result = Value::make<Table>();
+    for (oca_int i = 0; i < length(); ++i)
+        result.as<Table>().push(cast(begin + i));
+    return result;
+}
+
+oca_int Range::length() {
+    return (end < begin) ? 0 : end - begin + 1;
+}
+
+Value Range::item(oca_int index) {
+    if (index < 0 || index >= length())
+        return NIL;
+    return cast(begin + index);
+}
+
+std::string Range::tos() {
+    std::string result = "(";
+    for (oca_int i = begin; i <= end; ++i) {
+        result += std::to_string(i);
+        if (i != end)
+            result += ", ";
+    }
+    result += ")";
+    return result;
+}
+
+std::string Range::typestr() {
+    return "range";
+}
+
+// ---------------------------------
+
+Block::Block(ExprPtr expr, Scope* env, Evaluator* evaler)
+    : Object(KIND), evaler(evaler), val(expr), scope(nullptr) {
+    container = true;
+
+    // set parameters
+    std::string param = "";
+    for (char c : expr->val) {
+        if (c == ' ') {
+            params.push_back(param);
+            param = "";
+        } else
+            param += c;
+    }
+    if (param != "")
+        params.push_back(param);
+
+    if (env)
+        capture(*env);
+}
+
+void Block::capture(Scope& env) {
+    // the block keeps the variables it uses, so it can outlive the scope it was made in
+    for (auto& up : val->upvalues) {
+        if (evaler->state->global.find(up.first))
+            continue;
+        Variable* var = env.find(up.first);
+        if (!var) {
+            // assigned in the block makes it local, otherwise it is defined later
+            if (up.second)
+                continue;
+            env.push(up.first, false, {nullptr, Value::make<Cell>(nullptr)});
+            var = &env.vars.back();
+        }
+        scope.push(up.first, true, {nullptr, var->box()});
+    }
+}
+
+Value Block::rebind(Value block, const Scope& from, Scope& to) {
+    Block& old = block.as<Block>();
+    Value result = block;
+    for (uint i = 0; i < old.scope.vars.size(); ++i) {
+        const std::string& name = old.scope.name(i);
+        int source = from.layout()->find(name);
+        int target = to.layout()->find(name);
+        if (source == -1 || target == -1 || from.vars[source].cell != old.scope.vars[i].cell)
+            continue;
+        if (result == block) {
+            result = Value::make<Block>(old.val, nullptr, old.evaler);
+            result.as<Block>().params = old.params;
+            result.as<Block>().scope = old.scope;
+        }
+        result.as<Block>().scope.vars[i].cell = to.vars[target].box();
+    }
+    return result;
+}
+
+Value Block::operator()(Value caller, Value arg, Value block) {
+    Scope frame(&scope);
+    enter(frame, caller, arg, block);
+    Completion result = evaler->run(val, frame, true);
+
+    // calls in tail position reuse this frame instead of nesting
+    while (result.type == Completion::TAIL) {
+        TailCall next = std::move(evaler->tail);
+        evaler->tail = {};
+        Block& callee = next.block.as<Block>();
+        frame.clear();
+        frame.parent = &callee.scope;
+        callee.enter(frame, next.caller, next.arg, next.yield);
+        result = evaler->run(callee.val, frame, true);
+    }
+
+    if (!result.value)
+        return NIL;
+    return result.value;
+}
+
+void Block::enter(Scope& frame, Value caller, Value arg, Value block) {
+    // get argument count
+    uint argc = 0;
+    if (arg->ist() || arg.is<Range>())
+        argc = arg->length();
+    else if (!arg->isNil())
+        argc = 1;
+
+    // check argument count
+    if (argc == 0 && params.size() > 0)
+        throw Error(NO_ARGUMENT);
+    if (argc < params.size())
+        throw Error(
+            SMALL_TABLE, "(" + std::to_string(argc) + " < " + std::to_string(params.size()) + ").");
+
+    // set super and yield in scope
+    frame.set("yield", block, true);
+    frame.set("self", caller, true);
+
+    // set parameters
+    if (params.size() == 1)
+        frame.set(params[0], arg, true);
+    else {
+        oca_int counter = 0;
+        for (auto& param : params) {
+            Value item = arg->item(counter);
+            if (item->isNil())
+                throw Error(CANNOT_SPLIT);
+            ++counter;
+
+            frame.set(param, item, true);
+        }
+    }
+}
+
+// ---------------------------------
+
+Loop::Loop(Value block, Value self) : block(block), frame(nullptr) {
+    if (!block.is<Block>())
+        throw Error(CUSTOM_ERROR, "Expected a yield block.");
+    Block& yield = block.as<Block>();
+
+    // the block keeps the self of the place it was written in
+    frame.parent = &yield.scope;
+    frame.set("yield", NIL, true);
+    frame.set("self", self, true);
+    for (auto& param : yield.params)
+        frame.set(param, NIL, true);
+    bound = frame.vars.size();
+}
+
+Completion Loop::operator()(Value arg) {
+    auto& params = block.as<Block>().params;
+    if (params.size() == 1)
+        frame.vars[2].bind(arg);
+    else {
+        for (uint i = 0; i < params.size(); ++i) {
+            Value item = arg->item(i);
+            if (item->isNil())
+                throw Error(CANNOT_SPLIT);
+            frame.vars[2 + i].bind(item);
+        }
+    }
+    return step();
+}
+
+Completion Loop::operator()(Value first, Value second) {
+    auto& params = block.as<Block>().params;
+    if (params.size() == 1) {
+        Value pair = Value::make<Table>();
+        pair.as<Table>().push(first);
+        pair.as<Table>().push(second);
+        frame.vars[2].bind(pair);
+    } else if (params.size() == 2) {
+        frame.vars[2].bind(first);
+        frame.vars[3].bind(second);
+    } else if (params.size() > 2)
+        throw Error(CANNOT_SPLIT);
+    return step();
+}
+
+Completion Loop::step() {
+    // drop the locals of the previous iteration but keep the bound names
+    frame.truncate(bound);
+    Block& yield = block.as<Block>();
+    yield.evaler->safepoint();
+    return yield.evaler->settle(yield.evaler->run(yield.val, frame));
+}
+
+// ---------------------------------
+
+std::string Block::tos() {
+    const void* address = static_cast<const void*>(&*val);
+    std::stringstream ss;
+    ss << address;
+    return ss.str();
+}
+
+std::string Block::typestr() {
+    return "block";
+}
+
+void Block::trace(std::vector<Object*>& out) {
+    scope.trace(out);
+}
+
+void Block::clear() {
+    scope.clear();
+}
+
+// ---------------------------------
+
+Cell::Cell(Value value) : Object(KIND), value(value) {
+    container = true;
+}
+
+std::string Cell::tos() {
+    return value->tos();
+}
+
+std::string Cell::typestr() {
+    return value->typestr();
+}
+
+void Cell::trace(std::vector<Object*>& out) {
+    Object* object = value.object();
+    if (object && object->container)
+        out.push_back(object);
+}
+
+void Cell::clear() {
+    value = nullptr;
+}
+
+// ---------------------------------
+
+Func::Func(CPPFunc func, const std::string& params, bool spread)
+    : Object(KIND), val(func), params(params), spread(spread) {
+    signature.reserve(params.size());
+    for (char c : params) {
+        switch (c) {
+        case 'i': signature.push_back(INT); break;
+        case 'r': signature.push_back(REAL); break;
+        case 'n': signature.push_back(INT | REAL); break;
+        case 'b': signature.push_back(BOOL); break;
+        case 's': signature.push_back(STR); break;
+        case 't': signature.push_back(TABLE); break;
+        case 'k': signature.push_back(INT | STR); break;
+        default: signature.push_back(ANY); break;
+        }
+    }
+}
+
+uint Func::arity() const {
+    return static_cast<uint>(signature.size());
+}
+
+bool Func::spreads() const {
+    return spread;
+}
+
+Value Func::operator()(Value caller, Value arg, Value block, Value self) {
+    // get argument count
+    bool indexed = arg->ist() || arg.is<Range>();
+    uint argc = 0;
+    if (indexed)
+        argc = arg->length();
+    else if (!arg->isNil())
+        argc = 1;
+    if (indexed && argc == 0)
+        argc = 1;
+
+    // check argument count
+    if (argc == 0 && arity() > 0)
+        throw Error(NO_ARGUMENT);
+    if (argc < arity())
+        throw Error(
+            SMALL_TABLE, "(" + std::to_string(argc) + " < " + std::to_string(arity()) + ").");
+
+    // check argument types
+    for (uint i = 0; i < arity(); ++i)
+        check(i, (argc > 1 && arity() > 1) ? arg->item(i) : arg);
+
+    return val({caller, arg, block, nullptr, 0, self});
+}
+
+Value Func::operator()(Value caller, const Value* args, uint argc, Value block, Value self) {
+    if (argc < arity())
+        throw Error(
+            SMALL_TABLE, "(" + std::to_string(argc) + " < " + std::to_string(arity()) + ").");
+    for (uint i = 0; i < arity(); ++i)
+        check(i, args[i]);
+    return val({caller, NIL, block, args, argc, self});
+}
+
+uint8_t Func::mask(const Value& value) {
+    switch (value.tag()) {
+    case Value::INT: return INT;
+    case Value::REAL: return REAL;
+    case Value::BOOL: return BOOL;
+    case Value::STR: return STR;
+    case Value::OBJECT:
+        switch (value.object()->kind) {
+        case Object::INTEGER: return INT;
+        case Object::STRING: return STR;
+        case Object::TABLE: return TABLE;
+        default: return ANY;
+        }
+    default: return ANY;
+    }
+}
+
+void Func::check(uint index, const Value& value) const {
+    uint8_t wanted = signature[index];
+    if (wanted == ANY || (wanted & mask(value)))
+        return;
+    switch (params[index]) {
+    case 'i': throw Error(TYPE_MISMATCH, value.typestr() + " wanted int.");
+    case 'r': throw Error(TYPE_MISMATCH, value.typestr() + " wanted real.");
+    case 'n': throw Error(TYPE_MISMATCH, value.typestr() + " wanted int/real.");
+    case 'b': throw Error(TYPE_MISMATCH, value.typestr() + " wanted bool.");
+    case 's': throw Error(TYPE_MISMATCH, value.typestr() + " wanted str.");
+    case 't': throw Error(TYPE_MISMATCH, value.typestr() + " wanted table.");
+    default: throw Error(TYPE_MISMATCH, value.typestr() + " wanted oca_int/str.");
+    }
+}
+
+std::string Func::tos() {
+    const void* address = static_cast<const void*>(&val);
+    std::stringstream ss;
+    ss << address;
+    return ss.str();
+}
+
+std::string Func::typestr() {
+    return "func";
 }
 
-oca_real Value::tor() {
-    if (TYPE_EQ(*this, Real))
-        return static_cast<Real&>(*this).val;
-    else
-        return 0.0f;
+// ---------------------------------
+
+namespace {
+// the kernels are plain loops over contiguous numbers the compiler turns
+// into vector instructions, real sums keep four lanes so they can be
+template <class T>
+T total(const std::vector<T>& values) {
+    T lanes[4] = {};
+    size_t i = 0;
+    for (; i + 4 <= values.size(); i += 4)
+        for (size_t lane = 0; lane < 4; ++lane)
+            lanes[lane] += values[i + lane];
+    for (; i < values.size(); ++i)
+        lanes[0] += values[i];
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
 }
 
-bool Value::tob() {
-    if (TYPE_EQ(*this, Bool))
-        return static_cast<Bool&>(*this).val;
-    else
-        return false;
+template <class T>
+T dot(const std::vector<T>& left, const std::vector<T>& right) {
+    T lanes[4] = {};
+    size_t i = 0;
+    for (; i + 4 <= left.size(); i += 4)
+        for (size_t lane = 0; lane < 4; ++lane)
+            lanes[lane] += left[i + lane] * right[i + lane];
+    for (; i < left.size(); ++i)
+        lanes[0] += left[i] * right[i];
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
 }
 
-bool Value::isi() {
-    if (TYPE_EQ(*this, Integer))
-        return true;
-    else
-        return false;
+template <class T, class Less>
+T extreme(const std::vector<T>& values, Less less) {
+    T result = values[0];
+    for (size_t i = 1; i < values.size(); ++i)
+        result = less(values[i], result) ? values[i] : result;
+    return result;
 }
 
-bool Value::isr() {
-    if (TYPE_EQ(*this, Real))
-        return true;
-    else
-        return false;
+template <class T, class Op>
+void combine(std::vector<T>& left, const std::vector<T>& right, Op op) {
+    for (size_t i = 0; i < left.size(); ++i)
+        left[i] = op(left[i], right[i]);
 }
 
-bool Value::isb() {
-    if (TYPE_EQ(*this, Bool))
-        return true;
-    else
-        return false;
+template <class T, class Op>
+void broadcast(std::vector<T>& left, T right, Op op) {
+    for (size_t i = 0; i < left.size(); ++i)
+        left[i] = op(left[i], right);
 }
 
-bool Value::iss() {
-    if (TYPE_EQ(*this, String))
-        return true;
-    else
-        return false;
+Numbers numbers(const Value& table) {
+    Numbers result;
+    table.as<Table>().numbers(result);
+    return result;
 }
 
-bool Value::ist() {
-    if (TYPE_EQ(*this, Table))
-        return true;
-    else
-        return false;
+Value extreme(const Value& table, bool min) {
+    Numbers values = numbers(table);
+    if (values.size() == 0)
+        return NIL;
+    if (values.real) {
+        auto less = [min](oca_real a, oca_real b) { return (min) ? a < b : a > b; };
+        return Value::real(extreme(values.reals, less));
+    }
+    auto less = [min](oca_int a, oca_int b) { return (min) ? a < b : a > b; };
+    return Value::integer(extreme(values.ints, less));
 }
 
-// ---------------------------------
+// element by element with another table of the same length or with a number
+template <class Op>
+Value arithmetic(const Value& table, const Value& other, Op op, bool divide = false) {
+    if (!other.ist() && !other.isi() && !other.isr())
+        throw Error(TYPE_MISMATCH, other.typestr() + " wanted table/int/real.");
+    Numbers left = numbers(table);
+    if (other.ist()) {
+        Numbers right = numbers(other);
+        if (right.size() != left.size())
+            throw Error(CUSTOM_ERROR, "Tables of different sizes.");
+        if (left.real || right.real) {
+            left.widen();
+            right.widen();
+            combine(left.reals, right.reals, op);
+        } else {
+            if (divide && std::find(right.ints.begin(), right.ints.end(), 0) != right.ints.end())
+                throw Error(CUSTOM_ERROR, "Division by zero.");
+            combine(left.ints, right.ints, op);
+        }
+    } else if (other.isr() || left.real) {
+        left.widen();
+        broadcast(left.reals, other.isr() ? other.tor() : static_cast<oca_real>(other.toi()), op);
+    } else {
+        if (divide && other.toi() == 0)
+            throw Error(CUSTOM_ERROR, "Division by zero.");
+        broadcast(left.ints, other.toi(), op);
+    }
+    return Table::from(left);
+}
+}
 
-Integer::Integer(oca_int val, Scope* parent) : val(val) {
-    scope = Scope(parent);
+Methods::Methods(Pool* pool) {
+    Pool::Use use(pool);
 
-    // functions
-    bind("__add", "n", [&] CPPFUNC {
+    // int
+    bind(ints, "__add", "n", [&] CPPFUNC {
         oca_int left = arg.caller->toi();
         if (arg.value->isi())
             return cast(left + arg.value->toi());
@@ -94,7 +1030,7 @@ Integer::Integer(oca_int val, Scope* parent) : val(val) {
         return NIL;
     });
 
-    bind("__sub", "n", [&] CPPFUNC {
+    bind(ints, "__sub", "n", [&] CPPFUNC {
         oca_int left = arg.caller->toi();
         if (arg.value->isi())
             return cast(left - arg.value->toi());
@@ -103,7 +1039,7 @@ Integer::Integer(oca_int val, Scope* parent) : val(val) {
         return NIL;
     });
 
-    bind("__mul", "n", [&] CPPFUNC {
+    bind(ints, "__mul", "n", [&] CPPFUNC {
         oca_int left = arg.caller->toi();
         if (arg.value->isi())
             return cast(left * arg.value->toi());
@@ -112,7 +1048,7 @@ Integer::Integer(oca_int val, Scope* parent) : val(val) {
         return NIL;
     });
 
-    bind("__div", "n", [&] CPPFUNC {
+    bind(ints, "__div", "n", [&] CPPFUNC {
         oca_int left = arg.caller->toi();
         if (arg.value->isi())
             return cast(left / arg.value->toi());
@@ -121,15 +1057,15 @@ Integer::Integer(oca_int val, Scope* parent) : val(val) {
         return NIL;
     });
 
-    bind("__mod", "i", [&] CPPFUNC {
+    bind(ints, "__mod", "i", [&] CPPFUNC {
         oca_int left = arg.caller->toi();
         oca_int right = arg.value->toi();
         return cast(left % right);
     });
 
-    bind("__pow", "n", [&] CPPFUNC {
+    bind(ints, "__pow", "n", [&] CPPFUNC {
         oca_int left = arg.caller->toi();
-        ValuePtr right = arg.value;
+        Value right = arg.value;
         if (right->isi())
             return cast(static_cast<oca_int>(std::pow(left, right->toi())));
         if (right->isr())
@@ -137,19 +1073,19 @@ Integer::Integer(oca_int val, Scope* parent) : val(val) {
         return NIL;
     });
 
-    bind("__eq", "i", [&] CPPFUNC {
+    bind(ints, "__eq", "i", [&] CPPFUNC {
         oca_int left = arg.caller->toi();
         oca_int right = arg.value->toi();
         return cast(left == right);
     });
 
-    bind("__neq", "i", [&] CPPFUNC {
+    bind(ints, "__neq", "i", [&] CPPFUNC {
         oca_int left = arg.caller->toi();
         oca_int right = arg.value->toi();
         return cast(left != right);
     });
 
-    bind("__gr", "n", [&] CPPFUNC {
+    bind(ints, "__gr", "n", [&] CPPFUNC {
         oca_int left = arg.caller->toi();
         if (arg.value->isi())
             return cast(left > arg.value->toi());
@@ -158,7 +1094,7 @@ Integer::Integer(oca_int val, Scope* parent) : val(val) {
         return NIL;
     });
 
-    bind("__ls", "n", [&] CPPFUNC {
+    bind(ints, "__ls", "n", [&] CPPFUNC {
         oca_int left = arg.caller->toi();
         if (arg.value->isi())
             return cast(left < arg.value->toi());
@@ -167,102 +1103,78 @@ Integer::Integer(oca_int val, Scope* parent) : val(val) {
         return NIL;
     });
 
-    bind("__geq", "i", [&] CPPFUNC {
+    bind(ints, "__geq", "i", [&] CPPFUNC {
         oca_int left = arg.caller->toi();
         oca_int right = arg.value->toi();
         return cast(left >= right);
     });
 
-    bind("__leq", "i", [&] CPPFUNC {
+    bind(ints, "__leq", "i", [&] CPPFUNC {
         oca_int left = arg.caller->toi();
         oca_int right = arg.value->toi();
         return cast(left <= right);
     });
 
-    bind("__ran", "i", [&] CPPFUNC {
+    bind(ints, "__ran", "i", [&] CPPFUNC {
         oca_int begin = arg.caller->toi();
         oca_int end = arg.value->toi();
-        std::vector<oca_int> vec(end - begin + 1);
-        oca_int counter = 0;
-        for (oca_int i = begin; i <= end; ++i) {
-            vec[counter] = i;
-            ++counter;
-        }
-        return cast(vec);
+        return Value::make<Range>(begin, end);
     });
 
-    bind("__and", "i", [&] CPPFUNC {
+    bind(ints, "__and", "i", [&] CPPFUNC {
         oca_int left = arg.caller->toi();
         oca_int right = arg.value->toi();
         return cast(left & right);
     });
 
-    bind("__or", "i", [&] CPPFUNC {
+    bind(ints, "__or", "i", [&] CPPFUNC {
         oca_int left = arg.caller->toi();
         oca_int right = arg.value->toi();
         return cast(left | right);
     });
 
-    bind("__xor", "i", [&] CPPFUNC {
+    bind(ints, "__xor", "i", [&] CPPFUNC {
         oca_int left = arg.caller->toi();
         oca_int right = arg.value->toi();
         return cast(left ^ right);
     });
 
-    bind("__lsh", "i", [&] CPPFUNC {
+    bind(ints, "__lsh", "i", [&] CPPFUNC {
         oca_int left = arg.caller->toi();
         oca_int right = arg.value->toi();
         return cast(left << right);
     });
 
-    bind("__rsh", "i", [&] CPPFUNC {
+    bind(ints, "__rsh", "i", [&] CPPFUNC {
         oca_int left = arg.caller->toi();
         oca_int right = arg.value->toi();
         return cast(left >> right);
     });
 
-    bind("times", "", [&] CPPFUNC {
+    bind(ints, "times", "", [&] CPPFUNC {
         oca_int times = arg.caller->toi();
-        Block& yield = static_cast<Block&>(*arg.yield);
+        Loop loop(arg.yield, arg.self);
         for (oca_int i = 0; i < times; ++i) {
-            yield(Table::from(*arg.caller->scope.parent), cast(i), NIL);
+            if (loop(Value::integer(i)).type == Completion::BREAK)
+                break;
         }
         return NIL;
     });
 
-    bind("ascii", "", [&] CPPFUNC {
+    bind(ints, "ascii", "", [&] CPPFUNC {
         oca_int num = arg.caller->toi();
         char c = static_cast<char>(num);
         std::string empty = "";
         return cast(empty + c);
     });
 
-    bind("real", "", [&] CPPFUNC {
+    bind(ints, "real", "", [&] CPPFUNC {
         oca_int num = arg.caller->toi();
         return cast(static_cast<oca_real>(num));
     });
-}
-
-ValuePtr Integer::copy() {
-    return std::make_shared<Integer>(*this);
-}
-
-std::string Integer::tos() {
-    return std::to_string(val);
-}
-
-std::string Integer::typestr() {
-    return "int";
-}
-
-// ----------------------------------
 
-Real::Real(oca_real val, Scope* parent) : val(val) {
-    scope = Scope(nullptr);
-    scope.parent = parent;
-
-    // functions
-    bind("__add", "n", [&] CPPFUNC {
+    // real
+    bind(reals, "__add", "n", [&] CPPFUNC {
         oca_real left = arg.caller->tor();
         if (arg.value->isi())
             return cast(left + arg.value->toi());
@@ -271,7 +1183,7 @@ Real::Real(oca_real val, Scope* parent) : val(val) {
         return NIL;
     });
 
-    bind("__sub", "n", [&] CPPFUNC {
+    bind(reals, "__sub", "n", [&] CPPFUNC {
         oca_real left = arg.caller->tor();
         if (arg.value->isi())
             return cast(left - arg.value->toi());
@@ -280,7 +1192,7 @@ Real::Real(oca_real val, Scope* parent) : val(val) {
         return NIL;
     });
 
-    bind("__mul", "n", [&] CPPFUNC {
+    bind(reals, "__mul", "n", [&] CPPFUNC {
         oca_real left = arg.caller->tor();
         if (arg.value->isi())
             return cast(left * arg.value->toi());
@@ -289,7 +1201,7 @@ Real::Real(oca_real val, Scope* parent) : val(val) {
         return NIL;
     });
 
-    bind("__div", "n", [&] CPPFUNC {
+    bind(reals, "__div", "n", [&] CPPFUNC {
         oca_real left = arg.caller->tor();
         if (arg.value->isi())
             return cast(left / arg.value->toi());
@@ -298,9 +1210,9 @@ Real::Real(oca_real val, Scope* parent) : val(val) {
         return NIL;
     });
 
-    bind("__pow", "n", [&] CPPFUNC {
+    bind(reals, "__pow", "n", [&] CPPFUNC {
         oca_real left = arg.caller->tor();
-        ValuePtr right = arg.value;
+        Value right = arg.value;
         if (right->isi())
             return cast(static_cast<oca_real>(std::pow(left, right->toi())));
         if (right->isr())
@@ -308,7 +1220,7 @@ Real::Real(oca_real val, Scope* parent) : val(val) {
         return NIL;
     });
 
-    bind("__gr", "n", [&] CPPFUNC {
+    bind(reals, "__gr", "n", [&] CPPFUNC {
         oca_real left = arg.caller->tor();
         if (arg.value->isi())
             return cast(left > arg.value->toi());
@@ -317,7 +1229,7 @@ Real::Real(oca_real val, Scope* parent) : val(val) {
         return NIL;
     });
 
-    bind("__ls", "n", [&] CPPFUNC {
+    bind(reals, "__ls", "n", [&] CPPFUNC {
         oca_real left = arg.caller->tor();
         if (arg.value->isi())
             return cast(left < arg.value->toi());
@@ -326,116 +1238,87 @@ Real::Real(oca_real val, Scope* parent) : val(val) {
         return NIL;
     });
 
-    bind("floor", "", [&] CPPFUNC {
+    bind(reals, "floor", "", [&] CPPFUNC {
         oca_real num = arg.caller->tor();
         return cast(static_cast<oca_int>(std::floor(num)));
     });
 
-    bind("ceil", "", [&] CPPFUNC {
+    bind(reals, "ceil", "", [&] CPPFUNC {
         oca_real num = arg.caller->tor();
         return cast(static_cast<oca_int>(std::ceil(num)));
     });
 
-    bind("round", "", [&] CPPFUNC {
+    bind(reals, "round", "", [&] CPPFUNC {
         oca_real num = arg.caller->tor();
         return cast(static_cast<oca_int>(std::round(num)));
     });
-}
-
-ValuePtr Real::copy() {
-    return std::make_shared<Real>(*this);
-}
 
-std::string Real::tos() {
-    std::stringstream ss;
-    ss << std::setprecision(16) << std::fixed << val;
-    std::string str = ss.str();
-    str.erase(str.find_last_not_of('0') + 1, std::string::npos);
-    if (str.back() == '.')
-        str += '0';
-
-    return str;
-}
-
-std::string Real::typestr() {
-    return "real";
-}
-
-// ---------------------------------
-
-String::String(const std::string& val, Scope* parent) : val(val) {
-    scope = Scope(parent);
-
-    // functions
-    bind("__add", "a", [&] CPPFUNC {
-        std::string left = arg.caller->tos();
-        std::string right = arg.value->tos();
-        return cast(left + right);
+    // str
+    bind(strings, "__add", "a", [&] CPPFUNC {
+        if (arg.value.iss())
+            return String::concat(arg.caller, arg.value.view());
+        return String::concat(arg.caller, arg.value->tos());
     });
 
-    bind("__mul", "i", [&] CPPFUNC {
-        std::string left = arg.caller->tos();
+    bind(strings, "__mul", "i", [&] CPPFUNC {
+        std::string_view left = arg.caller.view();
         oca_int right = arg.value->toi();
         std::string result = "";
         if (right <= 0)
-            return cast(result); // TODO: should error
+            return cast(std::move(result)); // TODO: should error
+        result.reserve(left.size() * right);
         for (oca_int i = 0; i < right; ++i) {
             result += left;
         }
-        return cast(result);
+        return cast(std::move(result));
     });
 
-    bind("__eq", "s", [&] CPPFUNC {
-        std::string left = arg.caller->tos();
-        std::string right = arg.value->tos();
-        return cast(left == right);
+    bind(strings, "__eq", "s", [&] CPPFUNC {
+        return cast(String::equal(arg.caller, arg.value));
     });
 
-    bind("__neq", "s", [&] CPPFUNC {
-        std::string left = arg.caller->tos();
-        std::string right = arg.value->tos();
-        return cast(left != right);
+    bind(strings, "__neq", "s", [&] CPPFUNC {
+        return cast(!String::equal(arg.caller, arg.value));
     });
 
-    bind("size", "", [&] CPPFUNC {
-        std::string str = arg.caller->tos();
-        return cast(static_cast<oca_int>(str.size()));
+    bind(strings, "size", "", [&] CPPFUNC {
+        return cast(static_cast<oca_int>(arg.caller.view().size()));
     });
 
-    bind("upcase", "", [&] CPPFUNC {
+    bind(strings, "upcase", "", [&] CPPFUNC {
         std::string str = arg.caller->tos();
         std::string result;
         for (char c : str)
             result += std::toupper(c);
-        return cast(result);
+        return cast(std::move(result));
     });
 
-    bind("lowcase", "", [&] CPPFUNC {
+    bind(strings, "lowcase", "", [&] CPPFUNC {
         std::string str = arg.caller->tos();
         std::string result;
         for (char c : str)
             result += std::tolower(c);
-        return cast(result);
+        return cast(std::move(result));
     });
 
-    bind("int", "", [&] CPPFUNC {
+    bind(strings, "int", "", [&] CPPFUNC {
         std::string str = arg.caller->tos();
         return cast(std::stoll(str));
     });
 
-    bind("real", "", [&] CPPFUNC {
+    bind(strings, "real", "", [&] CPPFUNC {
         std::string str = arg.caller->tos();
         return cast(std::stod(str));
     });
 
-    bind("ascii", "", [&] CPPFUNC {
-        std::string str = arg.caller->tos();
+    bind(strings, "ascii", "", [&] CPPFUNC {
+        std::string_view str = arg.caller.view();
         if (str.size() != 1)
             throw Error(CUSTOM_ERROR, "String must be 1 character long.");
         return cast(static_cast<oca_int>(str.at(0)));
     });
 
-    bind("find", "s", [&] CPPFUNC {
+    bind(strings, "find", "s", [&] CPPFUNC {
         std::string str = arg.caller->tos();
         std::string regexString = arg.value->tos();
         std::regex regex(regexString);
@@ -446,7 +1329,7 @@ String::String(const std::string& val, Scope* parent) : val(val) {
             return cast(-1);
     });
 
-    bind("replace", "ss", [&] CPPFUNC {
+    bind(strings, "replace", "ss", [&] CPPFUNC {
         std::string str = arg.caller->tos();
         std::string regexString = arg[0]->tos();
         std::string replaceString = arg[1]->tos();
@@ -454,456 +1337,254 @@ String::String(const std::string& val, Scope* parent) : val(val) {
         return cast(std::regex_replace(str, regex, replaceString));
     });
 
-    bind("at", "i", [&] CPPFUNC {
-        std::string str = arg.caller->tos();
+    bind(strings, "at", "i", [&] CPPFUNC {
+        std::string_view str = arg.caller.view();
         oca_int index = arg.value->toi();
         if (index < 0 || index >= static_cast<oca_int>(str.size()))
             throw Error(CUSTOM_ERROR, "Index " + std::to_string(index) + " out of bounds.");
-        return cast(std::string() + str.at(index));
+        return Value::string(str.substr(index, 1));
     });
 
-    bind("each", "", [&] CPPFUNC {
-        std::string str = arg.caller->tos();
-        Block& yield = static_cast<Block&>(*arg.yield);
+    bind(strings, "each", "", [&] CPPFUNC {
+        std::string_view str = arg.caller.view();
+        Loop loop(arg.yield, arg.self);
         for (oca_int i = 0; i < static_cast<oca_int>(str.size()); ++i) {
-            auto table = std::make_shared<Table>(nullptr);
-            table->add("0", cast(i));
-            table->add("1", cast(std::string() + str.at(i)));
-            yield(Table::from(*arg.caller->scope.parent), table, NIL);
+            if (loop(Value::integer(i), Value::string(str.substr(i, 1))).type == Completion::BREAK)
+                break;
         }
         return arg.caller;
     });
 
-    bind("split", "s", [&] CPPFUNC {
-        std::string str = arg.caller->tos();
-        std::string delim = arg.value->tos();
-        std::string word = "";
-        auto result = std::make_shared<Table>(nullptr);
-        uint index = ARRAY_BEGIN_INDEX;
-        for (char c : str) {
-            if (c == delim[0]) {
-                result->add(std::to_string(index), cast(word));
-                word = "";
-                ++index;
-            } else
-                word += c;
+    bind(strings, "split", "s", [&] CPPFUNC {
+        std::string_view str = arg.caller.view();
+        std::string_view delim = arg.value.view();
+        Value result = Value::make<Table>();
+        Table& table = result.as<Table>();
+        size_t begin = 0;
+        // an empty delimiter never matches, like the terminator it used to read
+        for (size_t i = 0; i < str.size() && !delim.empty(); ++i) {
+            if (str[i] == delim[0]) {
+                table.push(Value::string(str.substr(begin, i - begin)));
+                begin = i + 1;
+            }
         }
-        result->add(std::to_string(index), cast(word));
+        table.push(Value::string(str.substr(begin)));
         return result;
     });
-}
-
-ValuePtr String::copy() {
-    return std::make_shared<String>(*this);
-}
-
-std::string String::tos() {
-    return val;
-}
 
-std::string String::typestr() {
-    return "str";
-}
-
-// ---------------------------------
-
-Bool::Bool(bool val, Scope* parent) : val(val) {
-    scope = Scope(nullptr);
-    scope.parent = parent;
-
-    bind("__eq", "b", [&] CPPFUNC {
+    // bool
+    bind(bools, "__eq", "b", [&] CPPFUNC {
         bool left = arg.caller->tob();
         bool right = arg.value->tob();
         return cast(left == right);
     });
 
-    bind("__neq", "b", [&] CPPFUNC {
+    bind(bools, "__neq", "b", [&] CPPFUNC {
         bool left = arg.caller->tob();
         bool right = arg.value->tob();
         return cast(left != right);
     });
 
-    bind("__and", "b", [&] CPPFUNC {
+    bind(bools, "__and", "b", [&] CPPFUNC {
         bool left = arg.caller->tob();
         bool right = arg.value->tob();
         return cast(left && right);
     });
 
-    bind("__or", "b", [&] CPPFUNC {
+    bind(bools, "__or", "b", [&] CPPFUNC {
         bool left = arg.caller->tob();
         bool right = arg.value->tob();
         return cast(left || right);
     });
-}
 
-ValuePtr Bool::copy() {
-    return std::make_shared<Bool>(*this);
-}
-
-std::string Bool::tos() {
-    return (val) ? "true" : "false";
-}
-
-std::string Bool::typestr() {
-    return "bool";
-}
-
-// ---------------------------------
-
-Table::Table(Scope* parent) {
-    scope = Scope(parent);
-
-    bind("size", "", [&] CPPFUNC {
-        auto table = arg.caller;
-        return cast(static_cast<oca_int>(static_cast<Table&>(*table).size));
+    // table
+    bind(tables, "size", "", [&] CPPFUNC {
+        return cast(arg.caller.as<Table>().size());
     });
 
-    bind("insert", "ka", [&] CPPFUNC {
-        auto& table = static_cast<Table&>(*arg.caller);
+    bind(tables, "insert", "ka", [&] CPPFUNC {
+        auto& table = arg.caller.as<Table>();
         std::string name = arg[0]->tos();
-        if (std::isdigit(name[0])) {
-            oca_int index = std::stoi(name);
-            if (index < 0 || index > table.count)
+        oca_int index = 0;
+        if (arg[0]->isi()) {
+            if (!table.index(name, index) || index > table.length())
                 throw Error(CUSTOM_ERROR, "Index " + name + " out of range(+1).");
-
-            std::vector<ValuePtr> array(table.count);
-            for (oca_int i = 0; i < table.count; ++i)
-                array[i] = table.scope.get(std::to_string(i), false);
-
-            array.insert(array.begin() + index, arg[1]);
-            table.add(std::to_string(table.count), cast(0));
-
-            for (uint i = 0; i < array.size(); ++i)
-                table.scope.set(std::to_string(i), array[i], true);
+            table.insert(index, arg[1]);
         } else
             table.add(name, arg[1]);
         return arg.caller;
     });
 
-    bind("remove", "k", [&] CPPFUNC {
-        auto& table = static_cast<Table&>(*arg.caller);
+    bind(tables, "remove", "k", [&] CPPFUNC {
+        auto& table = arg.caller.as<Table>();
         std::string name = arg.value->tos();
-        if (std::isdigit(name[0])) {
-            oca_int index = std::stoi(name);
-            if (index < 0 || index >= table.count)
+        oca_int index = 0;
+        if (arg.value->isi()) {
+            if (!table.index(name, index) || index >= table.length())
                 throw Error(CUSTOM_ERROR, "Index " + name + " out of range.");
-
-            std::vector<ValuePtr> array(table.count);
-            for (oca_int i = 0; i < table.count; ++i)
-                array[i] = table.scope.get(std::to_string(i), false);
-
-            array.erase(array.begin() + index);
-            table.remove(std::to_string(table.count - 1));
-
-            for (uint i = 0; i < array.size(); ++i)
-                table.scope.set(std::to_string(i), array[i], true);
-
+            table.remove(name);
         } else if (!table.remove(name))
             throw Error(CUSTOM_ERROR, "Key '" + name + "' does not exist.");
         return arg.caller;
     });
 
-    bind("at", "k", [&] CPPFUNC {
-        auto table = arg.caller;
-        std::string name = arg.value->tos();
-        return table->scope.get(name, false);
+    bind(tables, "at", "k", [&] CPPFUNC {
+        // string keys are looked up without a copy
+        if (arg.value.iss())
+            return arg.caller.as<Table>().get(arg.value.view(), false);
+        return arg.caller.as<Table>().get(arg.value->tos(), false);
     });
 
-    bind("each", "", [&] CPPFUNC {
-        auto& table = static_cast<Table&>(*arg.caller);
-        Block& yield = static_cast<Block&>(*arg.yield);
-        for (auto& var : table.scope.vars) {
-            auto& vref = *var.value;
-            if (TYPE_EQ(vref, Func))
+    bind(tables, "each", "", [&] CPPFUNC {
+        auto& table = arg.caller.as<Table>();
+        Loop loop(arg.yield, arg.self);
+        for (oca_int i = 0; i < table.length(); ++i) {
+            Value key = Value::integer(i + ARRAY_BEGIN_INDEX);
+            if (loop(key, table.item(i)).type == Completion::BREAK)
+                return arg.caller;
+        }
+        for (uint i = 0; i < table.scope.vars.size(); ++i) {
+            Value value = table.scope.vars[i].get();
+            if (!value || value.is<Func>())
                 continue;
-            auto param = std::make_shared<Table>(nullptr);
-            param->add("0", cast(var.name));
-            param->add("1", var.value);
-            yield(Table::from(*arg.caller->scope.parent), param, NIL);
+            if (loop(Value::string(table.scope.name(i)), value).type == Completion::BREAK)
+                break;
         }
         return arg.caller;
     });
 
-    bind("sort", "", [&] CPPFUNC {
-        auto& table = static_cast<Table&>(*arg.caller);
-        Block& yield = static_cast<Block&>(*arg.yield);
-        oca_int count = table.count;
-
-        std::vector<ValuePtr> array(count);
-        for (oca_int i = 0; i < count; ++i)
-            array[i] = table.scope.get(std::to_string(i), false);
-
-        std::sort(array.begin(), array.end(), [&](ValuePtr& a, ValuePtr& b) -> bool {
-            auto param = std::make_shared<Table>(nullptr);
-            param->add("0", a);
-            param->add("1", b);
-            return yield(Table::from(*arg.caller->scope.parent), param, NIL)->tob();
+    bind(tables, "sort", "", [&] CPPFUNC {
+        auto& table = arg.caller.as<Table>();
+        Loop loop(arg.yield, arg.self);
+        table.sort([&](const Value& a, const Value& b) -> bool {
+            return loop(a, b).value->tob();
         });
-
-        for (oca_int i = 0; i < count; ++i)
-            table.scope.set(std::to_string(i), array[i], true);
-
         return arg.caller;
     });
-}
-
-ValuePtr Table::copy() {
-    // return std::make_shared<Table>(*this);
-    return nullptr;
-}
 
-std::shared_ptr<Table> Table::from(Scope& scope) {
-    auto t = std::make_shared<Table>(nullptr);
-    t->scope = scope;
-    return t;
-}
+    bind(tables, "sum", "", [&] CPPFUNC {
+        Numbers values = numbers(arg.caller);
+        if (values.real)
+            return Value::real(total(values.reals));
+        return Value::integer(total(values.ints));
+    });
 
-void Table::add(const std::string& name, ValuePtr value) {
-    scope.set(name, value, true);
-    if (std::isdigit(name.at(0)))
-        ++count;
-    ++size;
-}
+    bind(tables, "mean", "", [&] CPPFUNC {
+        Numbers values = numbers(arg.caller);
+        if (values.size() == 0)
+            return NIL;
+        values.widen();
+        return Value::real(total(values.reals) / static_cast<oca_real>(values.size()));
+    });
 
-bool Table::remove(const std::string& name) {
-    if (scope.remove(name)) {
-        if (std::isdigit(name.at(0)))
-            --count;
-        --size;
-        return true;
-    }
-    return false;
-}
+    bind(tables, "min", "", [&] CPPFUNC {
+        return extreme(arg.caller, true);
+    });
 
-std::string Table::tos() {
-    std::string result = "(";
-    for (oca_int i = 0; i < count; ++i) {
-        result += scope.get(std::to_string(i), true)->tos();
-        result += ", ";
-    }
-    for (auto& var : scope.vars) {
-        auto& vref = *var.value;
-        if (TYPE_EQ(vref, Func))
-            continue;
-        if (std::isdigit(var.name[0]))
-            continue;
-        result += var.name + ": ";
-        result += var.value->tos();
-        result += ", ";
-    }
-    if (result.size() > 1) {
-        result.pop_back();
-        result.pop_back();
-    }
-    result += ")";
-    return result;
-}
+    bind(tables, "max", "", [&] CPPFUNC {
+        return extreme(arg.caller, false);
+    });
 
-std::string Table::typestr() {
-    std::string result = "(";
-    for (auto& var : scope.vars) {
-        auto& vref = *var.value;
-        if (TYPE_EQ(vref, Func))
-            continue;
-        result += var.value->typestr();
-        result += ", ";
-    }
-    if (result.size() > 1) {
-        result.pop_back();
-        result.pop_back();
-    }
-    result += ")";
-    return result;
-}
+    bind(tables, "dot", "t", [&] CPPFUNC {
+        Numbers left = numbers(arg.caller);
+        Numbers right = numbers(arg.value);
+        if (left.size() != right.size())
+            throw Error(CUSTOM_ERROR, "Tables of different sizes.");
+        if (!left.real && !right.real)
+            return Value::integer(dot(left.ints, right.ints));
+        left.widen();
+        right.widen();
+        return Value::real(dot(left.reals, right.reals));
+    });
 
-// ---------------------------------
+    bind(tables, "__add", "a", [&] CPPFUNC {
+        return arithmetic(arg.caller, arg.value, [](auto a, auto b) { return a + b; });
+    });
 
-Block::Block(ExprPtr expr, Scope* parent, Evaluator* evaler) : evaler(evaler) {
-    scope = Scope(parent);
-    val = expr;
+    bind(tables, "__sub", "a", [&] CPPFUNC {
+        return arithmetic(arg.caller, arg.value, [](auto a, auto b) { return a - b; });
+    });
 
-    // set parameters
-    std::string param = "";
-    for (char c : expr->val) {
-        if (c == ' ') {
-            params.push_back(param);
-            param = "";
-        } else
-            param += c;
-    }
-    if (param != "")
-        params.push_back(param);
-}
+    bind(tables, "__mul", "a", [&] CPPFUNC {
+        return arithmetic(arg.caller, arg.value, [](auto a, auto b) { return a * b; });
+    });
 
-ValuePtr Block::copy() {
-    return std::make_shared<Block>(*this);
-}
+    bind(tables, "__div", "a", [&] CPPFUNC {
+        return arithmetic(arg.caller, arg.value, [](auto a, auto b) { return a / b; }, true);
+    });
 
-ValuePtr Block::operator()(ValuePtr caller, ValuePtr arg, ValuePtr block) {
-    // get argument count
-    uint argc = 0;
-    if (arg->ist())
-        argc = static_cast<Table&>(*arg).count;
-    else if (!arg->isNil())
-        argc = 1;
+    bind(tables, "clone", "", [&] CPPFUNC {
+        return arg.caller.as<Table>().clone();
+    });
 
-    // check argument count
-    if (argc == 0 && params.size() > 0)
-        throw Error(NO_ARGUMENT);
-    if (argc < params.size())
-        throw Error(
-            SMALL_TABLE, "(" + std::to_string(argc) + " < " + std::to_string(params.size()) + ").");
+    bind(tables, "freeze", "", [&] CPPFUNC {
+        arg.caller.as<Table>().freeze();
+        return arg.caller;
+    });
 
-    // set super and yield in scope
-    Scope temp(&scope);
-    temp.set("yield", block, true);
-    temp.set("self", caller, true);
+    bind(tables, "frozen", "", [&] CPPFUNC {
+        return cast(arg.caller.as<Table>().isFrozen());
+    });
 
-    // set parameters
-    if (params.size() == 1)
-        temp.set(params[0], arg, true);
-    else {
-        uint counter = ARRAY_BEGIN_INDEX;
-        for (auto& param : params) {
-            ValuePtr item = arg->scope.get(std::to_string(counter), false);
-            if (item->isNil())
-                throw Error(CANNOT_SPLIT);
-            ++counter;
+    // range
+    bind(ranges, "size", "", [&] CPPFUNC {
+        return cast(arg.caller->length());
+    });
 
-            temp.set(param, item, true);
-        }
-    }
+    bind(ranges, "at", "i", [&] CPPFUNC {
+        oca_int index = arg.value->toi();
+        if (index < 0 || index >= arg.caller->length())
+            throw Error(CUSTOM_ERROR, "Index " + std::to_string(index) + " out of bounds.");
+        return arg.caller->item(index);
+    });
 
-    // evaluate the block's value
-    ValuePtr result = Nil::in(&scope);
-    ExprPtr expr = val;
-    while (expr) {
-        if (expr->left->type == Expression::RETURN)
-            return evaler->eval(expr->left->right, temp);
-        if (expr->left->type == Expression::BREAK)
-            return result;
-        result = evaler->eval(expr->left, temp);
-        if (evaler->returning) {
-            evaler->returning = false;
-            return result;
+    bind(ranges, "each", "", [&] CPPFUNC {
+        auto& range = arg.caller.as<Range>();
+        Loop loop(arg.yield, arg.self);
+        for (oca_int i = 0; i < range.length(); ++i) {
+            if (loop(Value::integer(i), Value::integer(range.begin + i)).type == Completion::BREAK)
+                break;
         }
-        expr = expr->right;
-    }
-
-    return result;
-}
-
-std::string Block::tos() {
-    const void* address = static_cast<const void*>(&*val);
-    std::stringstream ss;
-    ss << address;
-    return ss.str();
-}
-
-std::string Block::typestr() {
-    return "block";
-}
-
-// ---------------------------------
-
-Func::Func(CPPFunc func, const std::string& params, Scope* parent) : val(func), params(params) {
-    scope = Scope(parent);
-}
+        return arg.caller;
+    });
 
-ValuePtr Func::copy() {
-    return std::make_shared<Func>(*this);
+    bind(ranges, "table", "", [&] CPPFUNC {
+        return arg.caller.as<Range>().table();
+    });
 }
 
-ValuePtr Func::operator()(ValuePtr caller, ValuePtr arg, ValuePtr block) {
-    // get argument count
-    uint argc = 0;
-    if (arg->ist())
-        argc = static_cast<Table&>(*arg).count;
-    else if (!arg->isNil())
-        argc = 1;
-    if (arg->ist() && argc == 0)
-        argc = 1;
-
-    // check argument count
-    if (argc == 0 && params.size() > 0)
-        throw Error(NO_ARGUMENT);
-    if (argc < params.size())
-        throw Error(
-            SMALL_TABLE, "(" + std::to_string(argc) + " < " + std::to_string(params.size()) + ").");
-
-    // check argument types
-    for (uint i = 0; i < params.size(); ++i) {
-        ValuePtr v = arg;
-        if (argc > 1 && params.size() > 1)
-            v = arg->scope.get(std::to_string(i), false);
-        switch (params[i]) {
-        case 'i':
-            if (!v->isi())
-                throw Error(TYPE_MISMATCH, v->typestr() + " wanted int.");
-            break;
-        case 'r':
-            if (!v->isr())
-                throw Error(TYPE_MISMATCH, v->typestr() + " wanted real.");
-            break;
-        case 'n':
-            if (!v->isi() && !v->isr())
-                throw Error(TYPE_MISMATCH, v->typestr() + " wanted int/real.");
-            break;
-        case 'b':
-            if (!v->isb())
-                throw Error(TYPE_MISMATCH, v->typestr() + " wanted bool.");
-            break;
-        case 's':
-            if (!v->iss())
-                throw Error(TYPE_MISMATCH, v->typestr() + " wanted str.");
-            break;
-        case 't':
-            if (!v->ist())
-                throw Error(TYPE_MISMATCH, v->typestr() + " wanted table.");
-            break;
-        case 'k':
-            if (!v->isi() && !v->iss())
-                throw Error(TYPE_MISMATCH, v->typestr() + " wanted oca_int/str.");
-            break;
-        }
+Scope& Methods::of(const Value& value) {
+    switch (value.tag()) {
+    case Value::INT: return ints;
+    case Value::REAL: return reals;
+    case Value::BOOL: return bools;
+    case Value::STR: return strings;
+    case Value::OBJECT:
+        if (value.isi())
+            return ints;
+        if (value.iss())
+            return strings;
+        if (value.ist())
+            return tables;
+        if (value.is<Range>())
+            return ranges;
+        return none;
+    default: return none;
     }
-
-    return val({caller, arg, block});
-}
-
-std::string Func::tos() {
-    const void* address = static_cast<const void*>(&val);
-    std::stringstream ss;
-    ss << address;
-    return ss.str();
-}
-
-std::string Func::typestr() {
-    return "func";
-}
-
-// ---------------------------------
-
-std::shared_ptr<Nil> Nil::in(Scope* parent) {
-    auto n = std::make_shared<Nil>();
-    n->scope.parent = parent;
-    return n;
-}
-
-ValuePtr Nil::copy() {
-    return std::make_shared<Nil>(*this);
-}
-
-bool Nil::isNil() {
-    return true;
 }
 
-std::string Nil::tos() {
-    return "nil";
+Value Methods::get(const Value& value, std::string_view name, bool super) {
+    // members of a table come before the methods of all tables
+    if (value.ist()) {
+        Value member = value.as<Table>().get(name, super);
+        if (!member.isNil())
+            return member;
+    }
+    return of(value).get(name, true);
 }
 
-std::string Nil::typestr() {
-    return "nil";
+void Methods::bind(Scope& type, const std::string& name, const std::string& params, CPPFunc func) {
+    type.set(name, Value::make<Func>(func, params, true), true);
 }
 
 OCA_END
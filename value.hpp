@@ -7,117 +7,252 @@
 
 #include <string>
 #include <map>
-#include <any>
 #include "common.hpp"
+#include "box.hpp"
 #include "scope.hpp"
 
 OCA_BEGIN
 
-class Value {
+// ints that do not fit in the 48 bit payload of a value
+class Integer : public Object {
 public:
-    Scope scope = Scope(nullptr);
+    static constexpr Kind KIND = INTEGER;
 
-    virtual ~Value() = default;
-    virtual ValuePtr copy() = 0;
-    virtual bool isNil();
+    oca_int val;
+    explicit Integer(oca_int val);
+    std::string tos();
+    std::string typestr();
+};
+
+// strings never change, so values share them and equal ones can be interned.
+// a long string made by '+' only keeps the bytes it added and points at the
+// string in front of it, the pieces are joined the first time it is read
+class String : public Object {
+    std::string val;
+    Value prefix;
+    size_t size;
+    size_t hashed = 0;
 
-    virtual std::string tos() = 0;
-    virtual std::string typestr() = 0;
+public:
+    static constexpr Kind KIND = STRING;
 
-    oca_int toi();
-    oca_real tor();
-    bool tob();
+    bool interned = false;
 
-    bool isi();
-    bool isr();
-    bool isb();
-    bool iss();
-    bool ist();
+    explicit String(std::string val);
+    String(Value prefix, std::string_view suffix);
+    ~String();
 
-    void bind(const std::string& name, const std::string& args, CPPFunc func);
-};
+    static Value concat(const Value& left, std::string_view right);
+    static size_t length(const Value& value);
+    static bool equal(const Value& left, const Value& right);
 
-class Integer : public Value {
-public:
-    oca_int val;
-    Integer(oca_int val, Scope* parent);
-    ValuePtr copy();
+    const std::string& text();
+    size_t hash();
     std::string tos();
     std::string typestr();
+
+private:
+    // joins ropes shorter than this right away
+    static constexpr size_t ROPE = 64;
+
+    void flatten();
+    static void unlink(Value chain);
 };
 
-class Real : public Value {
+// a piece of the indexed elements of a table, clones of a table share
+// their chunks until one of them writes to it. numbers are stored in the
+// values themselves, so a chunk of them is a plain array of 8 byte words
+// the cycle collector can skip
+class Chunk : public Object {
 public:
-    oca_real val;
-    Real(oca_real val, Scope* parent);
-    ValuePtr copy();
+    static constexpr Kind KIND = CHUNK;
+    static constexpr uint SIZE = 32;
+
+    Value items[SIZE];
+    uint count = 0;
+    // items holding a table, block or cell
+    uint containers = 0;
+
+    Chunk();
+    Chunk(const Chunk& other);
+    void put(uint index, Value value);
     std::string tos();
     std::string typestr();
+    void trace(std::vector<Object*>& out);
+    void clear();
 };
 
-class String : public Value {
-public:
-    std::string val;
-    String(const std::string& val, Scope* parent);
-    ValuePtr copy();
-    std::string tos();
-    std::string typestr();
+// the indexed elements of a table as one kind of number, ints become
+// reals as soon as one of them is a real
+struct Numbers {
+    std::vector<oca_int> ints;
+    std::vector<oca_real> reals;
+    bool real = false;
+
+    size_t size() const;
+    void widen();
 };
 
-class Bool : public Value {
+// elements under the keys 0 .. length - 1 live in the array part,
+// every other key is a named member in the scope.
+// tables are shared between the values holding them, clone makes a new
+// one that shares the indexed elements until either side changes them.
+// a frozen table cannot be changed anymore
+class Table : public Object {
+    std::vector<Value> chunks;
+    oca_int count = 0;
+    bool frozen = false;
+
 public:
-    bool val;
-    Bool(bool val, Scope* parent);
-    ValuePtr copy();
+    static constexpr Kind KIND = TABLE;
+
+    Scope scope;
+    explicit Table(Scope* parent = nullptr);
+    static Value from(Scope& scope);
+    static Value from(const Numbers& numbers);
+    static bool index(std::string_view key, oca_int& index);
+    Value get(std::string_view key, bool super);
+    void set(const std::string& key, Value value, bool pub);
+    void add(const std::string& name, Value value);
+    void push(Value value);
+    void insert(oca_int index, Value value);
+    bool remove(const std::string& key);
+    void sort(const std::function<bool(const Value&, const Value&)>& less);
+    Value clone();
+    void rebind(const Scope& from);
+    void numbers(Numbers& out);
+    void freeze();
+    bool isFrozen() const;
+    oca_int length();
+    oca_int size();
+    Value item(oca_int index);
     std::string tos();
     std::string typestr();
+    void trace(std::vector<Object*>& out);
+    void clear();
+
+private:
+    void put(oca_int index, Value value);
+    void append(Value value);
+    void pop();
+    void check() const;
 };
 
-class Table : public Value {
+class Range : public Object {
 public:
-    oca_int count = 0;
-    oca_int size = 0;
-    explicit Table(Scope* parent);
-    static std::shared_ptr<Table> from(Scope& scope);
-    ValuePtr copy();
-    void add(const std::string& name, ValuePtr value);
-    bool remove(const std::string& name);
+    static constexpr Kind KIND = RANGE;
+
+    oca_int begin;
+    oca_int end;
+    Range(oca_int begin, oca_int end);
+    Value table();
+    oca_int length();
+    Value item(oca_int index);
     std::string tos();
     std::string typestr();
 };
 
-class Block : public Value {
+class Block : public Object {
     Evaluator* evaler;
 
 public:
+    static constexpr Kind KIND = BLOCK;
+
     ExprPtr val;
     std::vector<std::string> params;
-    Block(ExprPtr expr, Scope* parent, Evaluator* evaler);
-    ValuePtr operator()(ValuePtr caller, ValuePtr arg, ValuePtr block);
-    ValuePtr copy();
+    Scope scope;
+    Block(ExprPtr expr, Scope* env, Evaluator* evaler);
+    // a copy using the variables of to where this one captured those of from
+    static Value rebind(Value block, const Scope& from, Scope& to);
+    Value operator()(Value caller, Value arg, Value block);
     std::string tos();
     std::string typestr();
-};
+    void trace(std::vector<Object*>& out);
+    void clear();
 
-class Func : public Value {
-    CPPFunc val;
+private:
+    void capture(Scope& env);
+    void enter(Scope& frame, Value caller, Value arg, Value block);
+
+    friend class Loop;
+};
 
+// a variable captured by a closure, shared by every scope that uses it
+class Cell : public Object {
 public:
-    std::string params;
-    Func(CPPFunc func, const std::string& params, Scope* parent);
-    ValuePtr operator()(ValuePtr caller, ValuePtr arg, ValuePtr block);
-    ValuePtr copy();
+    static constexpr Kind KIND = CELL;
+
+    Value value;
+    explicit Cell(Value value);
     std::string tos();
     std::string typestr();
+    void trace(std::vector<Object*>& out);
+    void clear();
+};
+
+// calls a yield block once per iteration of a native loop, setting up its frame only once
+class Loop {
+    Value block;
+    Scope frame;
+    uint bound;
+
+public:
+    Loop(Value block, Value self);
+    Completion operator()(Value arg);
+    Completion operator()(Value first, Value second);
+
+private:
+    Completion step();
 };
 
-class Nil : public Value {
+// a native function, its parameter string is turned into one type mask
+// per parameter when it is bound
+class Func : public Object {
+    enum Mask : uint8_t { ANY = 0, INT = 1, REAL = 2, BOOL = 4, STR = 8, TABLE = 16 };
+
+    CPPFunc val;
+    std::string params;
+    std::vector<uint8_t> signature;
+    bool spread;
+
 public:
-    static std::shared_ptr<Nil> in(Scope* parent);
-    ValuePtr copy();
+    static constexpr Kind KIND = FUNC;
+    // written argument lists up to this long are passed without a table
+    static constexpr uint SPREAD = 8;
+
+    // a spread function reads its arguments through Arg::operator[], so a
+    // written list reaches it without a table, others always get arg.value
+    Func(CPPFunc func, const std::string& params, bool spread = false);
+    uint arity() const;
+    bool spreads() const;
+    Value operator()(Value caller, Value arg, Value block, Value self);
+    Value operator()(Value caller, const Value* args, uint argc, Value block, Value self);
     std::string tos();
     std::string typestr();
-    bool isNil();
+
+private:
+    static uint8_t mask(const Value& value);
+    void check(uint index, const Value& value) const;
+};
+
+// methods shared by every value of a type, looked up after table members
+class Methods {
+public:
+    Scope ints = Scope(nullptr);
+    Scope reals = Scope(nullptr);
+    Scope strings = Scope(nullptr);
+    Scope bools = Scope(nullptr);
+    Scope tables = Scope(nullptr);
+    Scope ranges = Scope(nullptr);
+    Scope none = Scope(nullptr);
+
+    // the methods are made in the pool of the State that owns them
+    explicit Methods(Pool* pool);
+    Scope& of(const Value& value);
+    Value get(const Value& value, std::string_view name, bool super);
+
+private:
+    void bind(Scope& type, const std::string& name, const std::string& params, CPPFunc func);
 };
 
 OCA_END